@@ -1,45 +1,44 @@
 #pragma once
 
+#include "interner.hpp"
 #include "literal.hpp"
 #include "token.hpp"
 #include "type.hpp"
 
-#include <memory>
-#include <optional>
-#include <string>
-#include <utility>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
 
-struct ASTVisitor;
+// Index of a node in its ASTContext. Children refer to each other by index,
+// so a tree is a handful of flat arrays rather than a web of pointers.
+using NodeId = std::uint32_t;
+inline constexpr NodeId noNode = UINT32_MAX;
 
-struct ASTNode {
-    int line = 0;
-    int column = 0;
-    virtual ~ASTNode() = default;
-    virtual void accept(ASTVisitor &visitor) = 0;
-};
-
-struct Expr : ASTNode {};
-struct Stmt : ASTNode {};
-
-using ExprPtr = std::unique_ptr<Expr>;
-using StmtPtr = std::unique_ptr<Stmt>;
+enum class NodeKind : std::uint8_t {
+    // expressions
+    Literal,  // a: index into literals
+    Variable, // a: name
+    Binary,   // op: BinaryOp, a: lhs, b: rhs
+    Unary,    // op: UnaryOp, a: operand
+    Call,     // a: callee, b: argument list
 
-struct LiteralExpr : Expr {
-    Literal value;
+    // statements
+    ExpressionStmt, // a: expression
+    Block,          // a: statement list
+    Fn,             // a: index into fns
+    Let,            // a: index into lets
+    Return,         // a: value or noNode
 
-    explicit LiteralExpr(Literal value) : value(value) {}
-    void accept(ASTVisitor &visitor) override;
+    Program, // a: statement list
 };
 
-struct VariableExpr : Expr {
-    std::string name;
-
-    explicit VariableExpr(std::string name) : name(std::move(name)) {}
-    void accept(ASTVisitor &visitor) override;
+struct Node {
+    NodeKind kind;
+    std::uint8_t op = 0;
+    std::uint32_t a = 0;
+    std::uint32_t b = 0;
 };
 
-enum class BinaryOp {
+enum class BinaryOp : std::uint8_t {
     Add, // x + y
     Sub, // x - y
     Mul, // x * y
@@ -55,125 +54,52 @@ enum class BinaryOp {
 
     // TODO: And, Or
 };
-BinaryOp tokenTypeToBinaryOp(TokenType tt);
-
-struct BinaryExpr : Expr {
-    BinaryOp op;
-    ExprPtr lhs;
-    ExprPtr rhs;
 
-    BinaryExpr(BinaryOp op, ExprPtr lhs, ExprPtr rhs)
-        : op(op), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
-    void accept(ASTVisitor &visitor) override;
-};
-
-enum class UnaryOp {
+enum class UnaryOp : std::uint8_t {
     Negate, // -x
     Not,    // !x
 };
 UnaryOp tokenTypeToUnaryOp(TokenType tt);
 
-struct UnaryExpr : Expr {
-    UnaryOp op;
-    ExprPtr operand;
-
-    UnaryExpr(UnaryOp op, ExprPtr operand)
-        : op(op), operand(std::move(operand)) {}
-    void accept(ASTVisitor &visitor) override;
-};
-
-struct CallExpr : Expr {
-    std::string callee;
-    std::vector<ExprPtr> args;
-
-    CallExpr(std::string callee, std::vector<ExprPtr> args)
-        : callee(std::move(callee)), args(std::move(args)) {}
-
-    void accept(ASTVisitor &visitor) override;
-};
-
-/////
-
-struct ExpressionStmt : Stmt {
-    ExprPtr expr;
-
-    explicit ExpressionStmt(ExprPtr expr) : expr(std::move(expr)) {}
-
-    void accept(ASTVisitor &visitor) override;
-};
-
-struct BlockStmt : Stmt {
-    std::vector<StmtPtr> stmts;
-
-    explicit BlockStmt(std::vector<StmtPtr> &&stmts)
-        : stmts(std::move(stmts)) {}
-
-    void accept(ASTVisitor &visitor) override;
-};
-
 struct FnParam {
-    std::string name;
+    Symbol name;
     Type type;
 
-    FnParam(std::string name, Type type) : name(std::move(name)), type(type) {}
+    FnParam(Symbol name, Type type) : name(name), type(type) {}
 };
 
-struct FnStmt : Stmt {
-    std::string name;
-    std::vector<FnParam> params;
+// payload of a Fn node
+struct FnDecl {
+    Symbol name;
     Type retType;
-    std::unique_ptr<BlockStmt> body;
-
-    explicit FnStmt(std::string name, std::vector<FnParam> params, Type retType,
-                    std::unique_ptr<BlockStmt> body)
-        : name(std::move(name)), params(std::move(params)), retType(retType),
-          body(std::move(body)) {}
-
-    void accept(ASTVisitor &visitor) override;
+    std::uint32_t firstParam;
+    std::uint32_t paramCount;
+    NodeId body; // Block
 };
 
-struct LetStmt : Stmt {
-    std::string name;
-    bool mut = false;
+// payload of a Let node
+struct LetDecl {
+    Symbol name;
+    bool mut;
     Type type;
-    ExprPtr initializer;
-
-    explicit LetStmt(std::string name, bool mut, Type type, ExprPtr initializer)
-        : name(std::move(name)), mut(mut), type(type),
-          initializer(std::move(initializer)) {}
-
-    void accept(ASTVisitor &visitor) override;
-};
-
-struct ReturnStmt : Stmt {
-    std::optional<ExprPtr> value;
-
-    ReturnStmt() : value(std::nullopt) {}
-    explicit ReturnStmt(ExprPtr value) : value(std::move(value)) {}
-
-    void accept(ASTVisitor &visitor) override;
+    NodeId initializer;
 };
 
-struct Program : ASTNode {
-    std::vector<StmtPtr> stmts;
-
-    void accept(ASTVisitor &visitor) override;
-};
+// Read-only view of a run of children stored in an ASTContext.
+template <typename T> class NodeList {
+  public:
+    NodeList() = default;
+    NodeList(const T *items, std::size_t count) : items(items), count(count) {}
 
-struct ASTVisitor {
-    virtual ~ASTVisitor() = default;
+    const T *begin() const { return this->items; }
+    const T *end() const { return this->items + this->count; }
 
-    virtual void visit(LiteralExpr &expr) = 0;
-    virtual void visit(VariableExpr &expr) = 0;
-    virtual void visit(BinaryExpr &expr) = 0;
-    virtual void visit(UnaryExpr &expr) = 0;
-    virtual void visit(CallExpr &expr) = 0;
+    std::size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
 
-    virtual void visit(ExpressionStmt &stmt) = 0;
-    virtual void visit(BlockStmt &stmt) = 0;
-    virtual void visit(FnStmt &stmt) = 0;
-    virtual void visit(LetStmt &stmt) = 0;
-    virtual void visit(ReturnStmt &stmt) = 0;
+    const T &operator[](std::size_t i) const { return this->items[i]; }
 
-    virtual void visit(Program &stmt) = 0;
+  private:
+    const T *items = nullptr;
+    std::size_t count = 0;
 };
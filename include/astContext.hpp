@@ -0,0 +1,141 @@
+#pragma once
+
+#include "ast.hpp"
+#include "interner.hpp"
+#include "literal.hpp"
+#include "type.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// Owns every node of one compilation as flat arrays: one Node per id, with
+// literals, child lists and declaration payloads in side arrays indexed from
+// the node. Creating a node is a push_back and the whole tree goes away with
+// a few frees.
+class ASTContext {
+  public:
+    ASTContext() = default;
+
+    ASTContext(const ASTContext &) = delete;
+    ASTContext &operator=(const ASTContext &) = delete;
+
+    NodeId addLiteral(Literal value);
+    NodeId addVariable(Symbol name);
+    NodeId addBinary(BinaryOp op, NodeId lhs, NodeId rhs);
+    NodeId addUnary(UnaryOp op, NodeId operand);
+    NodeId addCall(Symbol callee, const NodeId *args, std::size_t count);
+
+    NodeId addExpressionStmt(NodeId expr);
+    NodeId addBlock(const NodeId *stmts, std::size_t count);
+    NodeId addFn(Symbol name, const FnParam *params, std::size_t count,
+                 Type retType, NodeId body);
+    NodeId addLet(Symbol name, bool mut, Type type, NodeId initializer);
+    NodeId addReturn(NodeId value);
+
+    NodeId addProgram(const NodeId *stmts, std::size_t count);
+
+    // While hash-consing, adding a literal, variable, unary or binary node
+    // that is structurally identical to one added since the last
+    // closeSharingScope() returns the existing node instead, so a tree may
+    // share subexpressions. The parser closes the scope after every
+    // top-level declaration.
+    void enableHashConsing() { this->hashConsed = true; }
+    bool hashConsing() const { return this->hashConsed; }
+    void closeSharingScope();
+
+    // Moves all nodes of `other` to the end of this context and returns the
+    // amount its ids were shifted by. Appending the contexts of consecutive
+    // declarations in source order yields the same arrays as parsing them
+    // into one context.
+    NodeId append(const ASTContext &other);
+
+    NodeKind kind(NodeId id) const { return this->nodes[id].kind; }
+
+    const Literal &literal(NodeId id) const {
+        return this->literals[this->nodes[id].a];
+    }
+    Symbol variable(NodeId id) const { return this->nodes[id].a; }
+
+    BinaryOp binaryOp(NodeId id) const {
+        return static_cast<BinaryOp>(this->nodes[id].op);
+    }
+    NodeId lhs(NodeId id) const { return this->nodes[id].a; }
+    NodeId rhs(NodeId id) const { return this->nodes[id].b; }
+
+    UnaryOp unaryOp(NodeId id) const {
+        return static_cast<UnaryOp>(this->nodes[id].op);
+    }
+    NodeId operand(NodeId id) const { return this->nodes[id].a; }
+
+    Symbol callee(NodeId id) const { return this->nodes[id].a; }
+    NodeList<NodeId> args(NodeId id) const {
+        return this->list(this->nodes[id].b);
+    }
+
+    // ExpressionStmt
+    NodeId expr(NodeId id) const { return this->nodes[id].a; }
+
+    // Block and Program
+    NodeList<NodeId> stmts(NodeId id) const {
+        return this->list(this->nodes[id].a);
+    }
+
+    const FnDecl &fn(NodeId id) const { return this->fns[this->nodes[id].a]; }
+    NodeList<FnParam> params(const FnDecl &fn) const {
+        return NodeList<FnParam>(this->fnParams.data() + fn.firstParam,
+                                 fn.paramCount);
+    }
+
+    const LetDecl &let(NodeId id) const {
+        return this->lets[this->nodes[id].a];
+    }
+
+    // Return; noNode for a bare `return;`
+    NodeId returnValue(NodeId id) const { return this->nodes[id].a; }
+
+    // Passes rewrite a statement by pointing it at a new expression.
+    // Expression nodes themselves are never changed, as they may be shared.
+    void setExpr(NodeId stmt, NodeId expr) { this->nodes[stmt].a = expr; }
+    void setInitializer(NodeId let, NodeId expr) {
+        this->lets[this->nodes[let].a].initializer = expr;
+    }
+    void setReturnValue(NodeId ret, NodeId value) {
+        this->nodes[ret].a = value;
+    }
+
+    std::size_t size() const { return this->nodes.size(); }
+
+  private:
+    std::vector<Node> nodes;
+
+    std::vector<Literal> literals;
+    std::vector<FnDecl> fns;
+    std::vector<FnParam> fnParams;
+    std::vector<LetDecl> lets;
+
+    // child lists, each stored as its length followed by the ids
+    std::vector<NodeId> lists;
+
+    bool hashConsed = false;
+
+    struct NodeHash {
+        std::size_t operator()(const Node &node) const;
+    };
+    struct NodeEqual {
+        bool operator()(const Node &lhs, const Node &rhs) const {
+            return lhs.kind == rhs.kind && lhs.op == rhs.op &&
+                   lhs.a == rhs.a && lhs.b == rhs.b;
+        }
+    };
+    // pure nodes of the current sharing scope; literals are keyed by value
+    std::unordered_map<Node, NodeId, NodeHash, NodeEqual> uniqueNodes;
+
+    NodeId push(Node node);
+    NodeId pushUnique(Node node);
+    std::uint32_t pushList(const NodeId *items, std::size_t count);
+    NodeList<NodeId> list(std::uint32_t at) const {
+        return NodeList<NodeId>(this->lists.data() + at + 1, this->lists[at]);
+    }
+};
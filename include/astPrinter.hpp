@@ -1,24 +1,34 @@
 #pragma once
 
 #include "ast.hpp"
+#include "astContext.hpp"
+#include "interner.hpp"
 
-struct ASTPrinter : ASTVisitor {
-    int indentLevel = 0;
+#include <iostream>
+#include <ostream>
 
-    void visit(LiteralExpr &expr) override;
-    void visit(VariableExpr &expr) override;
-    void visit(BinaryExpr &expr) override;
-    void visit(UnaryExpr &expr) override;
-    void visit(CallExpr &expr) override;
+struct ASTPrinter {
+    const Interner &interner;
+    const ASTContext &ast;
+    std::ostream &os;
+    int indentLevel = 0;
 
-    void visit(ExpressionStmt &stmt) override;
-    void visit(BlockStmt &stmt) override;
-    void visit(FnStmt &stmt) override;
-    void visit(LetStmt &stmt) override;
-    void visit(ReturnStmt &stmt) override;
+    ASTPrinter(const Interner &interner, const ASTContext &ast,
+               std::ostream &os = std::cout)
+        : interner(interner), ast(ast), os(os) {}
 
-    void visit(Program &stmt) override;
+    void print(NodeId id);
 
   private:
+    void printExpr(NodeId root);
+
+    void printExpressionStmt(NodeId id);
+    void printBlock(NodeId id);
+    void printFn(NodeId id);
+    void printLet(NodeId id);
+    void printReturn(NodeId id);
+
+    void printProgram(NodeId id);
+
     void printIndent() const;
 };
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Register bytecode for the interpreter behind `slug run --interp`. Every
+// function works on its own window of registers: its parameters come first,
+// then its lets, then temporaries. A call's arguments are placed in
+// consecutive registers of the caller, which become the first registers of
+// the callee's window, and the callee leaves its result in the first of them.
+//
+// The opcode list is an X-macro so the interpreter's dispatch table is
+// generated in the same order as the enum.
+#define SLUG_OPCODES(X)                                                        \
+    X(LoadConst)  /* a = constants[bc] */                                      \
+    X(LoadGlobal) /* a = globals[bc] */                                        \
+    X(Move)       /* a = b */                                                  \
+    X(AddI)       /* a = b op c, on i32, wrapping like LLVM */                 \
+    X(SubI)                                                                    \
+    X(MulI)                                                                    \
+    X(DivI)                                                                    \
+    X(ModI)                                                                    \
+    X(AddF) /* a = b op c, on f64 */                                           \
+    X(SubF)                                                                    \
+    X(MulF)                                                                    \
+    X(DivF)                                                                    \
+    X(ModF)                                                                    \
+    X(EqI) /* a = b op c, on i32 and bool; the result is a bool */             \
+    X(NeI)                                                                     \
+    X(LtI)                                                                     \
+    X(LeI)                                                                     \
+    X(GtI)                                                                     \
+    X(GeI)                                                                     \
+    X(EqF) /* a = b op c, on f64; false when either is NaN */                  \
+    X(NeF)                                                                     \
+    X(LtF)                                                                     \
+    X(LeF)                                                                     \
+    X(GtF)                                                                     \
+    X(GeF)                                                                     \
+    X(NegI) /* a = op b */                                                     \
+    X(NegF)                                                                    \
+    X(Not)                                                                     \
+    X(Call)    /* call functions[bc] with its window starting at a */          \
+    X(Ret)     /* return a */                                                  \
+    X(RetVoid) /* return 0 from main, nothing from anything else */
+
+enum class Op : std::uint8_t {
+#define SLUG_OPCODE_ENUM(name) name,
+    SLUG_OPCODES(SLUG_OPCODE_ENUM)
+#undef SLUG_OPCODE_ENUM
+};
+
+// a, b and c are registers; instructions that index a table use b and c
+// together as one 32-bit index
+struct Instr {
+    Op op;
+    std::uint16_t a;
+    std::uint16_t b;
+    std::uint16_t c;
+
+    std::uint32_t index() const {
+        return static_cast<std::uint32_t>(this->b) |
+               static_cast<std::uint32_t>(this->c) << 16;
+    }
+};
+
+// One register. Types are checked when compiling, so each instruction knows
+// which member it reads; a bool is an i32 that is 0 or 1.
+union Slot {
+    std::int32_t i;
+    double f;
+};
+
+// compiled code the VM can call is found under the function's name with
+// this suffix, see LLVMCodeGen::generateSlotEntries()
+inline constexpr const char *slotEntrySuffix = ".slots";
+
+struct BytecodeFunction {
+    std::string name; // for runtime errors
+    std::uint32_t registerCount = 0;
+    std::vector<Instr> code;
+    std::vector<Slot> constants;
+};
+
+struct BytecodeModule {
+    std::vector<BytecodeFunction> functions;
+    std::vector<Slot> globals; // initial values
+    std::uint32_t mainIndex = 0;
+};
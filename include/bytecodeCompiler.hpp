@@ -0,0 +1,102 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "bytecode.hpp"
+#include "interner.hpp"
+#include "literal.hpp"
+#include "type.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Lowers a folded program to register bytecode for the VM, as the
+// alternative to LLVMCodeGen for `slug run --interp`. It checks types the
+// way codegen does, so a program that runs under one runs under the other
+// with the same result.
+//
+// Registers are handed out like a stack: a let keeps the register its
+// initializer was computed into, an immutable let initialized from another
+// variable shares that variable's register, and temporaries are released
+// as soon as the operator using them has been emitted.
+class BytecodeCompiler {
+  public:
+    BytecodeCompiler(const Interner &interner, const ASTContext &ast)
+        : interner(interner), ast(ast) {}
+
+    BytecodeModule compile(NodeId program);
+
+  private:
+    static constexpr std::uint32_t maxRegisters = UINT16_MAX;
+
+    const Interner &interner;
+    const ASTContext &ast;
+
+    BytecodeModule module;
+
+    struct FunctionInfo {
+        std::uint32_t index;
+        const FnDecl *decl;
+    };
+    std::unordered_map<Symbol, FunctionInfo> functions;
+
+    struct GlobalInfo {
+        std::uint32_t index;
+        PrimitiveType type;
+    };
+    std::unordered_map<Symbol, GlobalInfo> globals;
+
+    // the function being compiled
+    const FnDecl *fn = nullptr;
+    BytecodeFunction *out = nullptr;
+    PrimitiveType retType = PrimitiveType::Void;
+    bool returned = false;
+
+    struct Operand {
+        std::uint16_t reg;
+        PrimitiveType type;
+    };
+    // codegen keeps a single scope per function, so a let in a nested block
+    // stays visible until the end of the function
+    std::unordered_map<Symbol, Operand> locals;
+    // registers from here up are temporaries of the current statement
+    std::uint32_t firstTemp = 0;
+    std::uint32_t nextReg = 0;
+
+    // constant pool of the current function; i32 and bool constants share
+    // entries since they are stored alike
+    std::unordered_map<std::int32_t, std::uint32_t> intConstants;
+    std::unordered_map<std::uint64_t, std::uint32_t> floatConstants;
+
+    struct PendingExpr {
+        NodeId id;     // noNode: move the last result into argument `reg`
+        bool expanded; // operands already scheduled
+        std::uint32_t reg;
+    };
+    std::vector<PendingExpr> pendingExprs;
+    std::vector<Operand> operands;
+
+    void declareGlobal(const LetDecl &let);
+    void compileFn(const FnDecl &fn);
+    void compileStmt(NodeId id);
+    void compileLet(NodeId id);
+    void compileReturn(NodeId id);
+
+    Operand compileExpr(NodeId root);
+    Operand compileLiteral(const Literal &literal);
+    Operand compileVariable(NodeId id);
+    Operand compileBinary(NodeId id, Operand lhs, Operand rhs);
+    Operand compileUnary(NodeId id, Operand operand);
+    Operand compileCall(NodeId id, std::uint32_t base);
+
+    std::uint16_t allocate();
+    void release(Operand operand);
+    void emit(Op op, std::uint32_t a, std::uint32_t b = 0,
+              std::uint32_t c = 0);
+    void emitIndexed(Op op, std::uint16_t a, std::uint32_t index);
+
+    [[noreturn]] void error(const std::string &what) const;
+    std::string spelling(Symbol name) const;
+};
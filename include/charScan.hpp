@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+
+// Byte-class scanners used by the lexer to skip over runs of characters.
+// Each returns the length of the longest prefix of [begin, end) whose bytes
+// all belong to the class. On x86-64 they classify 16 (SSE2) or 32 (AVX2)
+// bytes per step, picked once at startup from the host CPU; everywhere else,
+// and for the tail of the buffer, a scalar loop is used. Nothing is ever read
+// past `end`.
+
+// ' ', '\t', '\r' and '\n'; the number of '\n' in the run is added to
+// `newlines`
+std::size_t scanWhitespace(const char *begin, const char *end, int &newlines);
+
+// [0-9A-Za-z]
+std::size_t scanAlnum(const char *begin, const char *end);
+
+// [0-9]
+std::size_t scanDigits(const char *begin, const char *end);
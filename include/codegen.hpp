@@ -1,87 +1,186 @@
 #pragma once
 
 #include "ast.hpp"
+#include "astContext.hpp"
+#include "compilerOptions.hpp"
+#include "interner.hpp"
+#include "target.hpp"
 
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
+#include <llvm/Target/TargetMachine.h>
 
 #include <llvm/Support/raw_ostream.h>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
-
-struct CodeGenVisitor : ASTVisitor {
-    virtual llvm::Value *visitExpr(Expr &) = 0;
-    virtual void visitStmt(Stmt &) = 0;
-};
+#include <vector>
 
 struct VariableInfo {
     llvm::Value *value;
     bool mut;
-    std::shared_ptr<Type> type;
+    Type type;
 
-    VariableInfo(llvm::Value *value, bool mut, std::shared_ptr<Type> type)
-        : value(std::move(value)), mut(mut), type(std::move(type)) {}
+    VariableInfo(llvm::Value *value, bool mut, Type type)
+        : value(value), mut(mut), type(type) {}
 };
 
-class LLVMCodeGen : public ASTVisitor {
+class LLVMCodeGen {
   public:
-    LLVMCodeGen()
-        : context(std::make_unique<llvm::LLVMContext>()),
-          module(std::make_unique<llvm::Module>("main", *context)),
-          builder(*context) {}
+    LLVMCodeGen(const Interner &interner, const ASTContext &ast,
+                const CompilerOptions &opts = {});
+    // gives the target machine back to the pool
+    ~LLVMCodeGen();
 
-    llvm::Module *getModule() { return module.get(); }
+    LLVMCodeGen(const LLVMCodeGen &) = delete;
+    LLVMCodeGen &operator=(const LLVMCodeGen &) = delete;
 
-    void emitObjectFile(const std::string &filename);
+    llvm::Module *getModule() { return module.get(); }
 
-    // Expr visitors
-    void visit(LiteralExpr &) override;
-    void visit(VariableExpr &) override;
-    void visit(BinaryExpr &) override;
-    void visit(UnaryExpr &) override;
-    void visit(CallExpr &) override;
+    // runs the default new-PM pipeline for the optimization level; does
+    // nothing at -O0
+    void optimize();
 
-    // Stmt visitors
-    void visit(ExpressionStmt &) override;
-    void visit(BlockStmt &) override;
-    void visit(FnStmt &) override;
-    void visit(LetStmt &) override;
-    void visit(ReturnStmt &) override;
-    void visit(Program &) override;
+    void emitObjectFile(const std::string &filename);
+    // the same object, e.g. into memory
+    void emitObject(llvm::raw_pwrite_stream &os);
+
+    // generates the whole module from a Program node
+    void generate(NodeId program);
+
+    // every function of a program by name, see setPartition()
+    using FunctionIndex = std::unordered_map<Symbol, const FnDecl *>;
+    static FunctionIndex indexFunctions(const ASTContext &ast, NodeId program);
+
+    // Makes generate() emit only the bodies of the functions among the
+    // program's top-level statements [first, last), to compile a program in
+    // parts: functions of other parts are found in `functions` and declared
+    // once called, and globals are only defined by the part that is given
+    // `defineGlobals`. The index is shared by all parts, so it must outlive
+    // generate().
+    void setPartition(std::size_t first, std::size_t last, bool defineGlobals,
+                      const FunctionIndex &functions);
+
+    // adds an entry point `<fn>.slots` for every function, which reads the
+    // arguments from an array of bytecode Slots and leaves the result in the
+    // first of them, so that the VM can call compiled code
+    void generateSlotEntries();
+
+    void dumpIR(llvm::raw_ostream &os = llvm::outs()) const {
+        this->module->print(os, nullptr);
+    }
+    // where generate() dumps the module when it fails to verify (stdout by
+    // default) and the scopes when a name is undefined (stderr)
+    void redirectDumps(llvm::raw_ostream &ir, llvm::raw_ostream &scopes) {
+        this->irDump = &ir;
+        this->scopeDump = &scopes;
+    }
 
-    void dumpIR() const { this->module->print(llvm::outs(), nullptr); }
+    // hands the module over together with its context, e.g. to the JIT;
+    // nothing can be generated or emitted afterwards
+    llvm::orc::ThreadSafeModule takeModule() {
+        return llvm::orc::ThreadSafeModule(std::move(this->module),
+                                           std::move(this->context));
+    }
 
   private:
+    const Interner &interner;
+    const ASTContext &ast;
+    OptLevel optLevel;
+    // for the target machine and every function
+    TargetSelection target;
     std::unique_ptr<llvm::LLVMContext> context;
     std::unique_ptr<llvm::Module> module;
     llvm::IRBuilder<> builder;
+    llvm::raw_ostream *irDump = &llvm::outs();
+    llvm::raw_ostream *scopeDump = &llvm::errs();
+
+    // taken from the pool on first use, for the host triple and the
+    // selected CPU, at the codegen level matching optLevel; also sets the
+    // module's triple and data layout
+    std::unique_ptr<llvm::TargetMachine> machine;
+    llvm::TargetMachine &targetMachine();
 
     // index 0 = global scope
-    std::vector<std::unordered_map<std::string, VariableInfo>> scopeStack;
+    std::vector<std::unordered_map<Symbol, VariableInfo>> scopeStack;
+    std::unordered_map<Symbol, llvm::Function *> functions;
+
+    // see setPartition(); by default the whole program
+    std::size_t partitionFirst = 0;
+    std::size_t partitionLast = SIZE_MAX;
+    bool definesGlobals = true;
+    const FunctionIndex *otherFunctions = nullptr;
+    bool inPartition(std::size_t stmt) const {
+        return stmt >= this->partitionFirst && stmt < this->partitionLast;
+    }
 
     void pushScope() { this->scopeStack.push_back({}); }
     void popScope() {
         if (!this->scopeStack.empty()) {
             this->scopeStack.pop_back();
         }
+        this->emittedValues.clear();
     }
-    void declareSymbol(const std::string &name, bool mut, const Type *type,
+    void declareSymbol(Symbol name, bool mut, const Type *type,
                        llvm::Value *value);
-    VariableInfo *findSymbol(const std::string &);
+    VariableInfo *findSymbol(Symbol);
     void dumpScopes() const;
 
     llvm::Value *lastValue = nullptr;
 
-    FnStmt *curFunc;
-
-    void declareGlobals(const Program &);
-    llvm::Value *generateFnPrototype(const FnStmt &);
-    void generateFnBody(FnStmt &);
-    void declareGlobalVariable(const LetStmt &);
+    const FnDecl *curFunc = nullptr;
+
+    void emit(NodeId id);
+
+    // expressions
+    struct PendingExpr {
+        NodeId id;
+        bool expanded; // operands already scheduled
+        llvm::Function *callee = nullptr;
+    };
+    std::vector<PendingExpr> pendingExprs;
+    std::vector<llvm::Value *> values;
+
+    // With a hash-consed AST, the value each shared pure node was last
+    // emitted as. Cleared whenever a name could start to mean something else.
+    std::unordered_map<NodeId, llvm::Value *> emittedValues;
+    llvm::Value *reusableValue(NodeId id) const;
+
+    void emitExpr(NodeId root);
+    void emitLiteral(NodeId id);
+    void emitVariable(NodeId id);
+    void emitBinary(NodeId id, llvm::Value *lhsValue, llvm::Value *rhsValue);
+    void emitUnary(NodeId id, llvm::Value *operandValue);
+    void emitCall(NodeId id, llvm::Function *calleeFn,
+                  llvm::ArrayRef<llvm::Value *> args);
+    llvm::Function *findFunction(Symbol name);
+
+    // statements
+    void emitExpressionStmt(NodeId id);
+    void emitBlock(NodeId id);
+    void emitLet(NodeId id);
+    void emitReturn(NodeId id);
+
+    void declareGlobals(NodeId program);
+    llvm::Value *generateFnPrototype(const FnDecl &);
+    void generateFnBody(const FnDecl &);
+    void declareGlobalVariable(const LetDecl &);
 
     llvm::Type *toLLVMType(const Type &type);
+
+    llvm::StringRef spelling(Symbol sym) const {
+        std::string_view name = this->interner.spelling(sym);
+        return llvm::StringRef(name.data(), name.size());
+    }
+    bool isMain(const FnDecl &fn) const {
+        return this->spelling(fn.name) == "main";
+    }
 };
@@ -1,8 +1,46 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
+
+// -O0 .. -O3, -Os, -Oz
+enum class OptLevel { O0, O1, O2, O3, Os, Oz };
 
 struct CompilerOptions {
-    std::string infile;
+    bool run = false;    // `slug run`: JIT-compile and execute main in-process
+    bool interp = false; // --interp: run on the bytecode VM instead of the JIT
+    std::string infile;  // "-" reads the source from stdin
+    // all sources given; with more than one, each is compiled on its own to
+    // <name>.o in the current directory, in parallel with -jN
+    std::vector<std::string> infiles;
     std::string outfile = "a.out";
+    // -jN; for a single source, more than one parses declarations in
+    // parallel and, unless running, compiles the program as up to N parts
+    // into <outfile>.<part>.o, or into <outfile> if it makes only one
+    unsigned jobs = 1;
+    bool hashCons = false; // --hash-cons; share identical subexpressions
+    // --cache-dir=DIR: compile function by function, reusing the objects of
+    // unchanged ones from DIR; the output is then a static archive. With
+    // `slug run`, the machine code of the whole program is kept there.
+    std::string cacheDir;
+    std::uint64_t cacheSize = 1024; // --cache-size=N MiB, then LRU eviction
+    OptLevel optLevel = OptLevel::O0;
+
+    // --tiered: start on the VM and compile hot functions in the background
+    bool tiered = false;
+    unsigned tierThreshold = 1000; // --tier-threshold=N interpreted calls
+    bool tierStats = false;        // --tier-stats
+
+    // --daemon[=SOCKET]: compile for `slugc` clients instead, with -jN of
+    // them at a time, by default as many as there are cores
+    std::string daemonSocket;
+    // sources and the objects of several are relative to this directory,
+    // or to the current one if empty; the daemon sets it to its client's
+    std::string workDir;
+
+    // -march= / -mcpu=; "native" is the host CPU along with its features
+    std::string cpu = "generic";
+    // -mattr=, e.g. "+avx2,-fma"; applied after the CPU's own features
+    std::string features;
 };
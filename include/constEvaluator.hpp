@@ -0,0 +1,71 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "interner.hpp"
+#include "literal.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Interprets calls to slug functions over the AST at compile time, so that
+// a global like `let SIZE: i32 = area(32, 32);` gets a constant initializer.
+// slug functions cannot have side effects, so any call whose arguments are
+// constants has a constant result; what bounds evaluation is a budget of
+// steps and of nested calls. Anything that cannot be evaluated is an error
+// naming the global being initialized.
+class ConstEvaluator {
+  public:
+    ConstEvaluator(const Interner &interner, const ASTContext &ast)
+        : interner(interner), ast(ast) {}
+
+    // makes a function callable at compile time
+    void addFunction(const FnDecl &fn) { this->functions[fn.name] = &fn; }
+
+    // the value of a global as seen by evaluated functions; std::nullopt
+    // when it is not a constant
+    void bindGlobal(Symbol name, std::optional<Literal> value);
+
+    // evaluates `callee(args...)` on behalf of the initializer of `owner`,
+    // with a fresh budget
+    Literal call(Symbol owner, Symbol callee, const Literal *args,
+                 std::size_t count);
+
+  private:
+    static constexpr std::size_t maxSteps = 1000000;
+    static constexpr std::size_t maxDepth = 256;
+
+    const Interner &interner;
+    const ASTContext &ast;
+
+    std::unordered_map<Symbol, const FnDecl *> functions;
+    std::unordered_map<Symbol, std::optional<Literal>> globals;
+
+    Symbol owner = 0;
+    std::size_t steps = 0;
+    std::size_t depth = 0;
+
+    // locals of every active call, innermost last; lookups stop at the
+    // start of the current frame
+    std::vector<std::pair<Symbol, Literal>> locals;
+    std::size_t frame = 0;
+
+    struct PendingExpr {
+        NodeId id;
+        bool expanded; // operands already scheduled
+    };
+    std::vector<PendingExpr> pendingExprs;
+    std::vector<Literal> values;
+
+    Literal callFn(Symbol callee, const Literal *args, std::size_t count);
+    bool execute(NodeId stmt, std::optional<Literal> &result);
+    Literal evaluate(NodeId root);
+    Literal lookup(Symbol name) const;
+
+    void step();
+    [[noreturn]] void fail(const std::string &why) const;
+};
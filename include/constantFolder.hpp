@@ -0,0 +1,65 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "constEvaluator.hpp"
+#include "interner.hpp"
+#include "literal.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Evaluates constant expressions ahead of codegen. Operators whose operands
+// are literals are replaced by their result, and uses of an immutable `let`
+// whose initializer folds to a literal of its declared type are replaced by
+// that literal, so e.g. `let N: i32 = 1024 * 16;` can size other globals.
+// Calls in global initializers are evaluated by a ConstEvaluator.
+//
+// Folding rebuilds an expression bottom-up and points its statement at the
+// new root; nodes are never modified, so a hash-consed tree stays valid.
+// Integer overflow and division by zero in a constant expression are
+// errors, reported instead of leaving undefined behaviour for LLVM.
+class ConstantFolder {
+  public:
+    ConstantFolder(const Interner &interner, ASTContext &ast)
+        : interner(interner), ast(ast), evaluator(interner, ast) {}
+
+    void fold(NodeId program);
+
+  private:
+    const Interner &interner;
+    ASTContext &ast;
+
+    // runs calls in global initializers
+    ConstEvaluator evaluator;
+
+    // the literal each visible name folds to, or noNode if it is not a
+    // constant; index 0 = global scope, mirroring codegen
+    std::vector<std::unordered_map<Symbol, NodeId>> scopes;
+
+    // the function or global being folded, for diagnostics
+    Symbol owner = 0;
+
+    struct PendingExpr {
+        NodeId id;
+        bool expanded; // operands already scheduled
+    };
+    std::vector<PendingExpr> pendingExprs;
+    std::vector<NodeId> results;
+    std::vector<Literal> callArgs;
+
+    void foldStmt(NodeId id);
+    void foldFn(const FnDecl &fn);
+
+    NodeId foldExpr(NodeId root);
+    NodeId foldVariable(NodeId id);
+    NodeId foldBinary(NodeId id, NodeId lhs, NodeId rhs);
+    NodeId foldUnary(NodeId id, NodeId operand);
+    NodeId foldCall(NodeId id, const NodeId *args);
+
+    void bind(Symbol name, NodeId value);
+    NodeId lookup(Symbol name) const;
+
+    [[noreturn]] void error(const std::string &what) const;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+
+// `slug --daemon` compiles for the thin client `slugc`, which connects to it
+// on a Unix domain socket, see daemonClient.hpp. Living on between
+// requests, the daemon keeps the targets initialized and its
+// TargetMachines pooled, and no request pays for starting a process and
+// loading LLVM.
+//
+// Requests run concurrently, each on one of the daemon's -jN threads. The
+// socket is only accessible to the user who started the daemon.
+class Daemon {
+  public:
+    // listens on `socket`, replacing a stale one that no daemon serves
+    Daemon(std::string socket, unsigned workers);
+    ~Daemon();
+
+    Daemon(const Daemon &) = delete;
+    Daemon &operator=(const Daemon &) = delete;
+
+    // serves requests until the process is killed
+    void serve();
+
+  private:
+    std::string socket;
+    unsigned workers;
+    int listener = -1;
+
+    void serveClient(int client);
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// The client side of `slug --daemon`, which the thin client `slugc` is built
+// from without LLVM, so that it starts in a fraction of the time slug does.
+// A request is a count, the client's working directory and its command
+// line; the reply is the exit status and what the compile printed to
+// stdout and stderr. Counts are 32 bits and strings are preceded by their
+// length, all in host byte order, as both ends run on the same host.
+
+// $XDG_RUNTIME_DIR/slug.sock, or /tmp/slug-<uid>.sock without one
+std::string defaultDaemonSocket();
+
+// Whether the daemon compiles this command line (without the program name)
+// for a client: not `slug run` or stdin, whose program and input belong to
+// the client, and nothing besides a compile.
+bool daemonCompiles(const std::vector<std::string> &args);
+
+// Has the daemon listening on `socket` compile `args`, prints what it
+// printed and returns its exit status; nothing if no daemon answered, in
+// which case the caller compiles by itself.
+std::optional<int> forwardToDaemon(const std::string &socket,
+                                   const std::vector<std::string> &args);
+
+// for the daemon; all throw when the connection fails
+void writeU32(int fd, std::uint32_t value);
+void writeString(int fd, const std::string &text);
+std::uint32_t readU32(int fd);
+std::string readString(int fd, std::uint32_t limit);
+
+// a stream socket bound to or connected to `socket`, or -1 with errno set
+int listenOn(const std::string &socket);
+int connectTo(const std::string &socket);
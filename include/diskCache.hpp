@@ -0,0 +1,51 @@
+#pragma once
+
+#include "compilerOptions.hpp"
+
+#include <cstdint>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <memory>
+#include <string>
+#include <string_view>
+
+// A directory of compiled code that compiles in any number of processes
+// share. An entry is written to a temporary file and renamed into place, and
+// read whole, so readers see all of an entry or none of it, and one that is
+// evicted while read stays intact for the reader.
+//
+// Eviction is by size, least recently used first, through LLVM's cache
+// pruning; loading an entry counts as using it.
+class DiskCache {
+  public:
+    // creates the directory if needed
+    DiskCache(std::string directory, std::uint64_t maxBytes);
+
+    // the entry for key, or nullptr if there is none
+    std::unique_ptr<llvm::MemoryBuffer> load(const std::string &key) const;
+
+    void store(const std::string &key, llvm::StringRef contents) const;
+
+    // evicts entries until the cache fits its size again, and removes
+    // temporaries that crashed stores left; as this scans the directory,
+    // call it once after storing a batch
+    void prune() const;
+
+  private:
+    std::string directory;
+    std::uint64_t maxBytes;
+
+    // pruning only ever touches files named like this
+    std::string path(const std::string &key) const {
+        return this->directory + "/llvmcache-" + key;
+    }
+};
+
+// hex SHA-1 of bytes, for naming entries
+std::string hashBytes(std::string_view bytes);
+
+// Everything besides the source that decides the code a compile produces:
+// the compiler's version and build ID, the LLVM version, the target and the
+// options. Part of every key, so that no entry is ever reused for different
+// code.
+std::string codeFingerprint(const CompilerOptions &opts);
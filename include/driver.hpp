@@ -3,6 +3,7 @@
 #include "compilerOptions.hpp"
 
 #include <exception>
+#include <ostream>
 
 class Driver {
   public:
@@ -11,9 +12,22 @@ class Driver {
 
     CompilerOptions parseArgs(int argc, char **argv);
 
-    void compile(const CompilerOptions &opts);
+    // returns the exit status: that of the program's main when running it;
+    // prints the AST and IR to `out` and reports to `err`
+    int compile(const CompilerOptions &opts, std::ostream &out,
+                std::ostream &err);
 
   private:
+    // one source
+    int compileFile(const CompilerOptions &opts, std::ostream &out,
+                    std::ostream &err);
+
+    // Several sources, each into an object of its own, on up to opts.jobs
+    // threads. What each file prints and its error are held back and
+    // reported in command-line order; the status is -1 if any failed.
+    int compileFiles(const CompilerOptions &opts, std::ostream &out,
+                     std::ostream &err);
+
     void showHelp();
     void showVersion();
 };
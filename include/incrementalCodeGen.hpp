@@ -0,0 +1,46 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "compilerOptions.hpp"
+#include "diskCache.hpp"
+#include "interner.hpp"
+
+#include <cstddef>
+#include <llvm/Support/raw_ostream.h>
+
+// Compiles a program incrementally, for `slug --cache-dir=DIR`. Every
+// function is hashed with everything its code depends on: its folded AST,
+// the signatures of the functions it calls, the globals it reads and the
+// options it is compiled with. Functions go through LLVM in short runs,
+// each kept in DIR as an object file under the hashes of its functions, so
+// a run none of whose functions changed is not compiled again and the LLVM
+// work of a compile follows the size of the edit rather than of the file.
+// Runs end after functions whose hash is a multiple of functionsPerUnit,
+// so adding or removing a function only changes the run around it. The
+// globals form one more unit of their own.
+//
+// The objects are written to the output as a static archive, which linkers
+// take in place of one object file. Runs are optimized on their own, so
+// nothing is inlined across them.
+class IncrementalCodeGen {
+  public:
+    IncrementalCodeGen(const Interner &interner, const ASTContext &ast,
+                       const CompilerOptions &opts);
+
+    // prints the IR of the units compiled this time to `out`, in program
+    // order
+    void compile(NodeId program, llvm::raw_ostream &out,
+                 llvm::raw_ostream &err);
+
+  private:
+    const Interner &interner;
+    const ASTContext &ast;
+    const CompilerOptions &opts;
+    // a module costs far more than a function, so functions are compiled
+    // in runs of about this many
+    static constexpr std::size_t functionsPerUnit = 16;
+    static constexpr std::size_t maxFunctionsPerUnit = 64;
+
+    DiskCache cache;
+};
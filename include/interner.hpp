@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Dense id of an interned identifier. Two symbols from the same interner are
+// equal exactly when their spellings are.
+using Symbol = std::uint32_t;
+
+// Maps every distinct identifier to a Symbol, so that the rest of the
+// compiler compares and hashes names as integers. Spellings are copied once
+// into chunks that never move, so the views spelling() hands out stay valid
+// for the interner's lifetime.
+class Interner {
+  public:
+    Interner() : slots(initialSlots, emptySlot) {}
+
+    Interner(const Interner &) = delete;
+    Interner &operator=(const Interner &) = delete;
+
+    Symbol intern(std::string_view name);
+
+    std::string_view spelling(Symbol sym) const { return this->names[sym]; }
+
+    std::size_t size() const { return this->names.size(); }
+
+  private:
+    static constexpr std::size_t initialSlots = 1024; // power of two
+    static constexpr std::size_t chunkSize = 64 * 1024;
+    static constexpr std::uint32_t emptySlot = UINT32_MAX;
+
+    std::vector<std::string_view> names;
+    std::vector<std::uint64_t> hashes;
+
+    // open addressing with linear probing, holding symbols
+    std::vector<std::uint32_t> slots;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    char *chunkPtr = nullptr;
+    std::size_t chunkLeft = 0;
+
+    static std::uint64_t hash(std::string_view name);
+    std::string_view store(std::string_view name);
+    void grow();
+};
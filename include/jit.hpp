@@ -0,0 +1,43 @@
+#pragma once
+
+#include "bytecode.hpp"
+#include "compilerOptions.hpp"
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+#include <string>
+
+// Compiles modules in-process with ORC's LLJIT for `slug run`, for the host
+// triple with the CPU, features and codegen level of the options, so that
+// the code matches what the object file emitter would produce.
+//
+// A lazy JIT compiles each function on its own, the first time it is looked
+// up or called, instead of compiling a whole module at once. Otherwise an
+// ObjectCache may be given, which the JIT asks for each module's object
+// before compiling it and hands every object it compiles.
+class JIT {
+  public:
+    using MainFn = int (*)();
+    using SlotEntry = void (*)(Slot *window);
+
+    explicit JIT(const CompilerOptions &opts, bool lazy = false,
+                 llvm::ObjectCache *cache = nullptr);
+
+    void addModule(llvm::orc::ThreadSafeModule module);
+    // machine code compiled before, e.g. taken from the cache
+    void addObject(std::unique_ptr<llvm::MemoryBuffer> object);
+
+    // compiles whatever `main` needs and returns its address
+    MainFn lookupMain();
+
+    // the address of `<fn>.slots`, see LLVMCodeGen::generateSlotEntries()
+    SlotEntry lookupSlotEntry(const std::string &fn);
+
+  private:
+    bool lazy;
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+};
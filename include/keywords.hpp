@@ -0,0 +1,105 @@
+#pragma once
+
+#include "token.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Keyword recognition through a perfect hash that is built entirely at
+// compile time. To add a keyword, append it to `keywords`; the seed search
+// below picks a collision-free hash for the new set, and the static_assert
+// fires if none fits in the table (grow `keywordTableSize` then).
+
+struct Keyword {
+    std::string_view spelling;
+    TokenType type;
+};
+
+inline constexpr Keyword keywords[] = {
+    {"fn", TokenType::Fn},     {"let", TokenType::Let},
+    {"mut", TokenType::Mut},   {"return", TokenType::Return},
+    {"true", TokenType::True}, {"false", TokenType::False},
+};
+
+inline constexpr std::size_t keywordTableSize = 32; // power of two
+
+namespace detail {
+
+constexpr std::uint32_t keywordHash(std::string_view s, std::uint32_t seed) {
+    auto first = static_cast<std::uint8_t>(s.front());
+    auto last = static_cast<std::uint8_t>(s.back());
+    std::uint32_t h = static_cast<std::uint32_t>(s.size()) * 0x9E3779B1u +
+                      first * seed + last * (seed * 31u + 17u);
+    return (h ^ (h >> 13)) & (keywordTableSize - 1);
+}
+
+constexpr bool isPerfect(std::uint32_t seed) {
+    bool used[keywordTableSize] = {};
+    for (const Keyword &kw : keywords) {
+        std::uint32_t h = keywordHash(kw.spelling, seed);
+        if (used[h]) {
+            return false;
+        }
+        used[h] = true;
+    }
+    return true;
+}
+
+constexpr std::uint32_t findSeed() {
+    for (std::uint32_t seed = 1; seed < 1u << 16; ++seed) {
+        if (isPerfect(seed)) {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+constexpr std::size_t keywordLength(bool longest) {
+    std::size_t len = keywords[0].spelling.size();
+    for (const Keyword &kw : keywords) {
+        if (longest ? kw.spelling.size() > len : kw.spelling.size() < len) {
+            len = kw.spelling.size();
+        }
+    }
+    return len;
+}
+
+inline constexpr std::uint32_t keywordSeed = findSeed();
+static_assert(keywordSeed != 0,
+              "no perfect hash for the keyword set, grow keywordTableSize");
+
+inline constexpr std::size_t minKeywordLength = keywordLength(false);
+inline constexpr std::size_t maxKeywordLength = keywordLength(true);
+
+constexpr std::array<Keyword, keywordTableSize> buildKeywordTable() {
+    std::array<Keyword, keywordTableSize> table{};
+    for (Keyword &slot : table) {
+        slot = {std::string_view(), TokenType::Identifier};
+    }
+    for (const Keyword &kw : keywords) {
+        table[keywordHash(kw.spelling, keywordSeed)] = kw;
+    }
+    return table;
+}
+
+inline constexpr std::array<Keyword, keywordTableSize> keywordTable =
+    buildKeywordTable();
+
+} // namespace detail
+
+// TokenType of the keyword spelled `s`, or TokenType::Identifier
+constexpr TokenType keywordType(std::string_view s) {
+    if (s.size() < detail::minKeywordLength ||
+        s.size() > detail::maxKeywordLength) {
+        return TokenType::Identifier;
+    }
+    const Keyword &slot =
+        detail::keywordTable[detail::keywordHash(s, detail::keywordSeed)];
+    return slot.spelling == s ? slot.type : TokenType::Identifier;
+}
+
+static_assert(keywordType("return") == TokenType::Return);
+static_assert(keywordType("returns") == TokenType::Identifier);
+static_assert(keywordType("fm") == TokenType::Identifier);
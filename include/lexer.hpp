@@ -1,38 +1,85 @@
 #pragma once
 
+#include "interner.hpp"
 #include "literal.hpp"
+#include "sourceFile.hpp"
 #include "token.hpp"
 
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory>
 #include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Lexer {
   public:
-    Lexer() : start(0), cur(0), line(1) {}
+    explicit Lexer(Interner &interner)
+        : interner(interner), start(0), cur(0), line(1) {}
     ~Lexer() = default;
 
-    std::vector<Token> lex(const std::string &infile);
+    // Each call to next() appends one token to `store`, ending with an Eof
+    // token that is repeated on every further call. Regular files are
+    // mapped; anything else (stdin, pipes) is read in chunks.
+    void open(const std::string &infile);
+    void open(std::unique_ptr<SourceFile> file);
+    void open(std::istream &in);
+    void next(TokenStore &store);
+
+    // Tells a streaming lexer that no token starting before `offset` will be
+    // looked at again, so that part of the input can be dropped on the next
+    // refill. Without it the whole input is retained.
+    void release(std::uint64_t offset) { this->released = offset; }
 
   private:
-    std::string src;
-    std::vector<Token> tokens;
+    static constexpr std::size_t chunkSize = 64 * 1024;
+
+    Interner &interner;
+
+    std::unique_ptr<SourceFile> file;
+    std::unique_ptr<std::istream> ownedStream;
+    std::istream *in = nullptr;
+    std::string buffer;
+    std::uint64_t base = 0; // absolute offset of src[0]
+    std::uint64_t released = 0;
+
+    std::string_view src;
+    TokenStore *out = nullptr;
     int start, cur;
     int line;
 
-    std::string readFile(const std::string &infile);
-
     void scanTokens();
 
     void addTokenWithLiteral(TokenType type, std::optional<Literal> literal);
     void addToken(TokenType type);
+    void addIdentifier(Symbol name);
+    std::uint32_t tokenOffset() const;
+    std::uint16_t tokenLength() const;
+
+    static constexpr std::size_t maxLiteralDigits = 128;
 
     void number();
+    void decimalDigits();
+    void radixDigits(int base);
+    std::size_t literalDigits(char (&buf)[maxLiteralDigits], int base);
+    void integerLiteral(int base);
+    void floatLiteral();
     void identifier();
+    void skipDigits();
+
+    std::runtime_error error(const std::string &msg) const;
+
+    bool refill();
 
     char advance();
     char peek();
     char peekNext();
     bool match(char expected);
     bool isAtEnd();
+
+    const char *curPtr() const { return this->src.data() + this->cur; }
+    const char *endPtr() const { return this->src.data() + this->src.size(); }
 };
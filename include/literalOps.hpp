@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ast.hpp"
+#include "literal.hpp"
+#include "type.hpp"
+
+#include <optional>
+
+// Operators applied to literal values at compile time, with the semantics
+// of the instructions codegen would emit. Shared by constant folding and
+// compile-time function evaluation so both agree on every result.
+
+struct LiteralResult {
+    // no value and no error: the operation is left for codegen, e.g. mixed
+    // operand types
+    std::optional<Literal> value;
+    const char *error = nullptr; // "Integer overflow", "Division by zero"
+};
+
+LiteralResult applyBinary(BinaryOp op, const Literal &lhs,
+                          const Literal &rhs);
+LiteralResult applyUnary(UnaryOp op, const Literal &operand);
+
+bool hasType(const Literal &literal, const Type &type);
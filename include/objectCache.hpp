@@ -0,0 +1,29 @@
+#pragma once
+
+#include "diskCache.hpp"
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+
+#include <memory>
+
+// Lets the JIT keep the machine code it compiles in a DiskCache, for
+// `slug run --cache-dir=DIR`. A module is stored under its identifier, so
+// that must be a key that covers everything its code depends on.
+//
+// The cache is only an optimization: an entry that cannot be read or
+// written is compiled again next time, and never fails the run.
+class DiskObjectCache : public llvm::ObjectCache {
+  public:
+    explicit DiskObjectCache(const DiskCache &cache) : cache(cache) {}
+
+    void notifyObjectCompiled(const llvm::Module *module,
+                              llvm::MemoryBufferRef object) override;
+
+    std::unique_ptr<llvm::MemoryBuffer>
+    getObject(const llvm::Module *module) override;
+
+  private:
+    const DiskCache &cache;
+};
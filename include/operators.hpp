@@ -0,0 +1,59 @@
+#pragma once
+
+#include "ast.hpp"
+#include "token.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Binding power of the binary operators, looked up by token type. Tokens
+// that are not binary operators have precedence -1. To add an operator, give
+// it an entry below; a higher precedence binds tighter.
+
+struct BinaryOperator {
+    std::int8_t precedence;
+    bool rightAssoc;
+    BinaryOp op;
+};
+
+// prefix operators (-x, !x) bind tighter than any binary operator
+inline constexpr std::int8_t prefixPrecedence = 7;
+
+inline constexpr auto binaryOperators = [] {
+    std::array<BinaryOperator, 256> table{};
+    for (BinaryOperator &entry : table) {
+        entry = {-1, false, BinaryOp::Add};
+    }
+    auto set = [&table](TokenType type, std::int8_t precedence, BinaryOp op) {
+        table[static_cast<std::size_t>(type)] = {precedence, false, op};
+    };
+
+    set(TokenType::Star, 6, BinaryOp::Mul);
+    set(TokenType::Slash, 6, BinaryOp::Div);
+    set(TokenType::Percent, 6, BinaryOp::Mod);
+
+    set(TokenType::Plus, 5, BinaryOp::Add);
+    set(TokenType::Minus, 5, BinaryOp::Sub);
+
+    set(TokenType::Less, 4, BinaryOp::Lt);
+    set(TokenType::LessEqual, 4, BinaryOp::Lte);
+    set(TokenType::Greater, 4, BinaryOp::Gt);
+    set(TokenType::GreaterEqual, 4, BinaryOp::Gte);
+
+    set(TokenType::EqualEqual, 3, BinaryOp::Eq);
+    set(TokenType::BangEqual, 3, BinaryOp::Neq);
+
+    // TODO: And (2), Or (1)
+
+    return table;
+}();
+
+constexpr const BinaryOperator &binaryOperator(TokenType type) {
+    return binaryOperators[static_cast<std::size_t>(type)];
+}
+
+static_assert(binaryOperator(TokenType::Star).precedence >
+              binaryOperator(TokenType::Plus).precedence);
+static_assert(binaryOperator(TokenType::Identifier).precedence == -1);
+static_assert(prefixPrecedence > binaryOperator(TokenType::Star).precedence);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Runs body(i) for every i in [0, count) on up to `jobs` threads, the calling
+// thread included, and returns once all of them are done. Indices are handed
+// out in increasing order from a shared counter. `body` must not throw;
+// callers record failures per index and act on them afterwards.
+template <typename F>
+void parallelFor(std::size_t count, unsigned jobs, const F &body) {
+    std::atomic<std::size_t> next{0};
+    auto work = [&]() {
+        for (std::size_t i = next++; i < count; i = next++) {
+            body(i);
+        }
+    };
+
+    std::size_t threads = std::min<std::size_t>(jobs, count);
+    std::vector<std::thread> workers;
+    for (std::size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(work);
+    }
+    work();
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "compilerOptions.hpp"
+#include "interner.hpp"
+
+#include <cstddef>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+#include <vector>
+
+// Compiles a program in parts on several threads, for `slug -jN`. The
+// top-level declarations are split into up to N runs of consecutive ones of
+// about the same size, and each run is generated, optimized and emitted by
+// an LLVMCodeGen of its own (its own context, module and target machine)
+// into an object file of its own; the first one also defines the globals.
+// With a single part, e.g. for a program of one function, the output file
+// is written as without -jN.
+//
+// The parts depend only on the program and N, and the IR and the first
+// error are reported in part order, so the output is the same from run to
+// run.
+class ParallelCodeGen {
+  public:
+    ParallelCodeGen(const Interner &interner, const ASTContext &ast,
+                    const CompilerOptions &opts)
+        : interner(interner), ast(ast), opts(opts) {}
+
+    // prints the IR to `out`, and returns the object files written in part
+    // order
+    std::vector<std::string> compile(NodeId program, llvm::raw_ostream &out,
+                                     llvm::raw_ostream &err);
+
+    // where part i of `count` is emitted; a program that is not split goes
+    // to the output file like a sequential compile
+    std::string objectFile(std::size_t part, std::size_t count) const {
+        if (count == 1) {
+            return this->opts.outfile;
+        }
+        return this->opts.outfile + "." + std::to_string(part) + ".o";
+    }
+
+  private:
+    const Interner &interner;
+    const ASTContext &ast;
+    const CompilerOptions &opts;
+
+    struct Part {
+        std::size_t first; // top-level statements [first, last)
+        std::size_t last;
+    };
+    std::vector<Part> split(NodeId program) const;
+};
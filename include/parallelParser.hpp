@@ -0,0 +1,44 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "lexer.hpp"
+#include "token.hpp"
+
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+// Parses the top-level declarations of a source on several threads. The
+// whole input is lexed first, a brace-matching pre-pass splits the tokens at
+// declaration boundaries, and runs of consecutive declarations are parsed
+// into contexts of their own that are appended to the result in source
+// order.
+//
+// Whenever the pre-pass or a worker sees something a sequential parse would
+// not (an error, or a declaration that ends somewhere else), the tokens are
+// parsed again sequentially, so the AST and the first error reported are
+// exactly those of Parser::parse.
+class ParallelParser {
+  public:
+    ParallelParser(Lexer &lexer, ASTContext &context, unsigned jobs)
+        : lexer(lexer), context(context), jobs(jobs) {}
+
+    // returns the Program node
+    NodeId parse();
+
+  private:
+    // batches per thread, so that uneven declarations still balance out
+    static constexpr std::size_t batchesPerJob = 8;
+
+    Lexer &lexer;
+    ASTContext &context;
+    unsigned jobs;
+
+    TokenStore tokens;
+    std::exception_ptr lexError;
+
+    void lexAll();
+    bool findDeclarations(std::vector<std::size_t> &starts) const;
+    NodeId parseSequential();
+};
@@ -1,51 +1,72 @@
 #pragma once
 
 #include "ast.hpp"
+#include "astContext.hpp"
+#include "interner.hpp"
 #include "token.hpp"
+#include "tokenStream.hpp"
 #include "type.hpp"
 
-#include <memory>
+#include <cstddef>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class Parser {
   public:
-    explicit Parser(const std::vector<Token> &tokens) : tokens(tokens) {}
+    Parser(TokenStream &tokens, ASTContext &context)
+        : tokens(tokens), context(context) {}
 
-    std::unique_ptr<Program> parse();
+    // returns the Program node
+    NodeId parse();
+
+    // parses a single top-level declaration
+    NodeId parseDeclaration();
 
   private:
-    const std::vector<Token> &tokens;
-    int cur = 0;
+    TokenStream &tokens;
+    ASTContext &context;
+
+    // children are gathered on these stacks and copied into the context
+    // once their parent is complete, so nested lists share the same buffers
+    std::vector<NodeId> scratch;
+    std::vector<FnParam> paramScratch;
 
-    StmtPtr declaration();
-    StmtPtr fnDeclaration();
-    StmtPtr letDeclaration();
-    StmtPtr returnDeclaration();
+    NodeId declaration();
+    NodeId fnDeclaration();
+    NodeId letDeclaration();
+    NodeId returnDeclaration();
 
-    std::unique_ptr<BlockStmt> parseBlock();
+    NodeId parseBlock();
 
-    ExprPtr expression();
-    ExprPtr parseBinaryRhs(int precedence, ExprPtr lhs);
-    ExprPtr unary();
-    ExprPtr primary();
-    ExprPtr finishCall(const std::string &callee);
+    // an operator or bracket still waiting for its operands
+    struct PendingOp {
+        enum Kind : std::uint8_t { Binary, Unary, Paren, Call };
 
-    int getPrecedence(TokenType type) const;
+        Kind kind;
+        std::uint8_t op; // BinaryOp or UnaryOp
+        std::int8_t precedence;
+        Symbol callee;         // Call
+        std::uint32_t argMark; // Call: where its arguments start in scratch
+    };
+    std::vector<NodeId> operands;
+    std::vector<PendingOp> operators;
 
-    bool isBinaryOp(TokenType type) const;
+    NodeId expression();
+    void reduce(std::size_t base, int precedence, bool rightAssoc);
 
-    Type parseType(const std::string &lexeme);
+    Type parseType(std::string_view lexeme);
 
     bool match(TokenType type);
 
-    const Token &advance();
+    Token advance();
 
-    const Token &consume(TokenType expected, const std::string &err);
+    Token consume(TokenType expected, const char *err);
 
-    const Token &peek() const;
+    Token peek();
 
-    const Token &previous() const;
+    Token previous() const;
 
-    bool isAtEnd() const;
+    bool isAtEnd();
 };
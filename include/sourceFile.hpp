@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Read-only view of a source file. Regular files are memory mapped so the
+// lexer and its tokens can refer straight into the page cache; anything that
+// can't be mapped (pipes, character devices, empty files) is read into an
+// owned buffer instead.
+class SourceFile {
+  public:
+    explicit SourceFile(const std::string &path);
+    ~SourceFile();
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    std::string_view text() const { return {this->data, this->size}; }
+
+    // whether `path` names a regular file, i.e. one that can be mapped
+    static bool isRegularFile(const std::string &path);
+
+  private:
+    const char *data = nullptr;
+    std::size_t size = 0;
+    bool mapped = false;
+    std::string fallback;
+};
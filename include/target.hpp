@@ -0,0 +1,33 @@
+#pragma once
+
+#include "compilerOptions.hpp"
+
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Target/TargetMachine.h>
+
+#include <memory>
+#include <string>
+
+// What to generate code for, as chosen with -march/-mcpu/-mattr. Shared by
+// the object file emitter and the JIT so both build the same code.
+struct TargetSelection {
+    std::string cpu;
+    std::string features; // comma-separated, e.g. "+avx2,-fma"
+};
+
+// Resolves "native" to the host CPU and every feature it reports; explicit
+// -mattr features come last so that they win.
+TargetSelection selectTarget(const CompilerOptions &opts);
+
+// the backend optimization level clang pairs with each -O level
+llvm::CodeGenOptLevel codeGenOptLevel(OptLevel level);
+
+// Creating a TargetMachine costs more than compiling a small file, so
+// compiles take theirs from a process-wide pool and give them back when
+// done, for later compiles of the process to reuse, like the daemon's. A
+// machine is only used by one compile at a time, and the pool keeps at most
+// one idle machine per core for each target. Targets are initialized on
+// first use. Throws for a CPU the host's target does not know.
+std::unique_ptr<llvm::TargetMachine>
+acquireTargetMachine(const TargetSelection &target, OptLevel level);
+void releaseTargetMachine(std::unique_ptr<llvm::TargetMachine> machine);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "bytecode.hpp"
+#include "compilerOptions.hpp"
+#include "interner.hpp"
+#include "jit.hpp"
+#include "vm.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compiles the functions a VM reports as hot, for `slug run --tiered`, on a
+// background thread while the VM keeps interpreting. The first request
+// generates the whole program at -O2 into a lazy JIT; after that, each hot
+// function is compiled on its own and installed in the VM, so later calls
+// to it run native code.
+//
+// The AST and the interner are read from the background thread, so they
+// must not change until finish() has returned.
+class TierUp {
+  public:
+    TierUp(const Interner &interner, const ASTContext &ast, NodeId program,
+           const BytecodeModule &module, VM &vm, const CompilerOptions &opts);
+    ~TierUp() { this->finish(); }
+
+    TierUp(const TierUp &) = delete;
+    TierUp &operator=(const TierUp &) = delete;
+
+    // queues fn to be compiled; called by the VM
+    void request(std::uint32_t fn);
+
+    // drops queued requests and waits for the compile in progress
+    void finish();
+
+    // the calls each function got and when it tiered up
+    void dumpStats(std::ostream &os) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    const Interner &interner;
+    const ASTContext &ast;
+    NodeId program;
+    const BytecodeModule &module;
+    VM &vm;
+    CompilerOptions opts;
+    Clock::time_point start = Clock::now();
+
+    struct Request {
+        std::uint32_t fn;
+        Clock::time_point at;
+    };
+    struct Event {
+        std::uint32_t fn;
+        double requestedMs; // since start
+        double installedMs; // since start; negative if compiling failed
+        double compileMs;
+        std::string error;
+    };
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<Request> queue;
+    std::vector<Event> events;
+    bool stopping = false;
+
+    // only touched by the worker
+    std::unique_ptr<JIT> jit;
+    std::thread worker;
+
+    void work();
+    VM::NativeFn compile(std::uint32_t fn);
+};
@@ -1,12 +1,16 @@
 #pragma once
 
+#include "interner.hpp"
 #include "literal.hpp"
 
+#include <cstddef>
+#include <cstdint>
 #include <optional>
 #include <ostream>
-#include <string>
+#include <string_view>
+#include <vector>
 
-enum class TokenType {
+enum class TokenType : std::uint8_t {
     // Single character tokens
     LeftParen,  // (
     RightParen, // )
@@ -60,21 +64,101 @@ enum class TokenType {
 
 std::ostream &operator<<(std::ostream &os, TokenType t);
 
+// Struct-of-arrays token storage. The hot per-token data the parser looks at
+// (type, source offset, length, payload) lives in parallel arrays. The
+// payload of an Identifier is its interned name and that of a Number the
+// position of its value in a side table of number literals. Line numbers
+// are kept as runs since consecutive tokens mostly share a line.
+//
+// Offsets are absolute positions in the input. Lexemes are resolved against
+// `source`, which covers the input from `sourceBase` on: the whole file
+// when it is mapped, or the lexer's current buffer when streaming. A store
+// can also act as a sliding window (see dropFront()), in which case token
+// indices stay absolute while the oldest tokens are discarded.
+class TokenStore {
+  public:
+    // longest lexeme a token can have
+    static constexpr std::size_t maxLength = UINT16_MAX;
+
+    void push(TokenType type, std::uint32_t offset, std::uint16_t length,
+              int line, std::optional<Literal> literal);
+    void pushIdentifier(std::uint32_t offset, std::uint16_t length, int line,
+                        Symbol name);
+
+    // forgets the `count` oldest tokens
+    void dropFront(std::size_t count);
+
+    void setSource(std::string_view source, std::uint64_t sourceBase) {
+        this->source = source;
+        this->sourceBase = sourceBase;
+    }
+
+    // absolute index range of the tokens held
+    std::size_t begin() const { return this->first; }
+    std::size_t end() const { return this->first + this->types.size(); }
+
+    TokenType type(std::size_t index) const {
+        return this->types[index - this->first];
+    }
+    std::uint32_t offset(std::size_t index) const {
+        return this->offsets[index - this->first];
+    }
+    std::string_view lexeme(std::size_t index) const {
+        std::size_t i = index - this->first;
+        return this->source.substr(this->offsets[i] - this->sourceBase,
+                                   this->lengths[i]);
+    }
+    std::optional<Literal> literal(std::size_t index) const;
+    // throws for anything but an Identifier token held by the store
+    Symbol symbol(std::size_t index) const;
+    int line(std::size_t index) const;
+
+  private:
+    // token indices fit in 32 bits since offsets do
+
+    struct LineRun {
+        std::uint32_t index; // first token on `line`
+        int line;
+    };
+
+    std::vector<TokenType> types;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint16_t> lengths;
+    std::vector<std::uint32_t> payloads;
+    // payload of a Number token pushed without a value
+    static constexpr std::uint32_t noNumber = UINT32_MAX;
+
+    // numbers[i] is the number with payload firstNumber + i, as dropFront()
+    // also drops the oldest numbers
+    std::vector<Literal> numbers;
+    std::uint32_t firstNumber = 0;
+    std::vector<LineRun> lines;
+
+    std::size_t first = 0;
+
+    std::string_view source;
+    std::uint64_t sourceBase = 0;
+};
+
+// Lightweight handle to a token in a TokenStore. It stays usable as long as
+// the token is held by the store, and its lexeme as long as the lexer that
+// produced it keeps that part of the input around.
 class Token {
   public:
-    Token(TokenType type_, const std::string &lexeme_,
-          std::optional<Literal> literal_, int line_)
-        : type(type_), lexeme(lexeme_), literal(literal_), line(line_) {}
-    ~Token() = default;
+    Token(const TokenStore &store, std::size_t index)
+        : store(&store), index(index) {}
 
-    TokenType getType() const { return this->type; }
-    const std::string &getLexeme() const { return this->lexeme; }
-    const std::optional<Literal> &getLiteral() const { return this->literal; }
-    int getLine() const { return this->line; }
+    TokenType getType() const { return this->store->type(this->index); }
+    std::string_view getLexeme() const {
+        return this->store->lexeme(this->index);
+    }
+    std::optional<Literal> getLiteral() const {
+        return this->store->literal(this->index);
+    }
+    Symbol getSymbol() const { return this->store->symbol(this->index); }
+    int getLine() const { return this->store->line(this->index); }
 
   private:
-    TokenType type;
-    std::string lexeme;
-    std::optional<Literal> literal;
-    int line;
+    const TokenStore *store;
+    std::size_t index;
 };
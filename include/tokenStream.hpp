@@ -0,0 +1,70 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "token.hpp"
+
+#include <cstddef>
+#include <exception>
+#include <utility>
+
+// Token source for the parser. It either walks a store that was lexed up
+// front, or pulls tokens from the lexer on demand into a small sliding
+// window, so that memory use is bounded by the lookahead instead of the size
+// of the input.
+//
+// Several streams may read one shared store at different positions, which
+// is how declarations are parsed concurrently.
+//
+// Handles returned by peek()/advance()/previous() are invalidated once the
+// token falls out of the window (at least `window` tokens later); callers
+// that need a lexeme beyond that have to copy it.
+class TokenStream {
+  public:
+    explicit TokenStream(Lexer &lexer) : lexer(&lexer) {}
+    explicit TokenStream(TokenStore tokens)
+        : store(std::move(tokens)), cur(this->store.begin()) {}
+
+    // Reads `tokens` from token `first` on without copying them. If the store
+    // was cut short by a lexer error, `pending` is rethrown once the parser
+    // asks for the token that could not be lexed.
+    TokenStream(const TokenStore &tokens, std::size_t first,
+                std::exception_ptr pending = nullptr)
+        : tokens(&tokens), cur(first), pending(std::move(pending)) {}
+
+    TokenStream(const TokenStream &) = delete;
+    TokenStream &operator=(const TokenStream &) = delete;
+
+    // current token, pulling it from the lexer if needed
+    Token peek() {
+        if (this->cur == this->tokens->end()) {
+            this->pull();
+        }
+        return Token(*this->tokens, this->cur);
+    }
+
+    // consumes the current token (unless it is Eof) and returns it
+    Token advance() {
+        Token tok = this->peek();
+        if (tok.getType() != TokenType::Eof) {
+            this->cur++;
+        }
+        return tok;
+    }
+
+    // the most recently consumed token
+    Token previous() const { return Token(*this->tokens, this->cur - 1); }
+
+    // absolute index of the current token
+    std::size_t position() const { return this->cur; }
+
+  private:
+    static constexpr std::size_t window = 8;
+
+    Lexer *lexer = nullptr;
+    TokenStore store;
+    const TokenStore *tokens = &this->store;
+    std::size_t cur = 0; // absolute token index
+    std::exception_ptr pending;
+
+    void pull();
+};
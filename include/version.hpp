@@ -0,0 +1,6 @@
+#pragma once
+
+// The version --version reports. Cache keys go by the build ID of the
+// executable as well, so a change to the code the compiler generates needs
+// no bump to keep caches from handing out an older build's code.
+inline constexpr const char *slugVersion = "0.1.0";
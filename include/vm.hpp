@@ -0,0 +1,76 @@
+#pragma once
+
+#include "bytecode.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Runs a BytecodeModule for `slug run --interp`. The register file and the
+// call stack are allocated once up front, so a call is a bounds check and
+// a few stores; nothing is allocated while the program runs. Where LLVM's
+// code would trap (division by zero, INT_MIN / -1) or the native stack
+// would overflow, running stops with an error instead.
+//
+// Functions can be swapped for compiled code while the program runs: every
+// call looks in a table of native entry points first, and counts the calls
+// it interprets so that hot functions can be reported for compiling.
+class VM {
+  public:
+    // takes its arguments from, and leaves its result in, the callee's
+    // window, see LLVMCodeGen::generateSlotEntries()
+    using NativeFn = void (*)(Slot *window);
+
+    explicit VM(const BytecodeModule &module);
+
+    // returns main's result, the exit status of the program
+    int run();
+
+    // onHot(fn) is called, on the interpreting thread, once fn has been
+    // interpreted `threshold` times
+    void setTierUp(std::uint64_t threshold,
+                   std::function<void(std::uint32_t)> onHot);
+
+    // makes calls to fn run `code`; safe to call from any thread
+    void install(std::uint32_t fn, NativeFn code) {
+        this->native[fn].store(code, std::memory_order_release);
+    }
+
+    // calls made through the VM; calls from compiled code to compiled code
+    // never come back to it
+    std::uint64_t interpretedCalls(std::uint32_t fn) const {
+        return this->interpreted[fn];
+    }
+    std::uint64_t nativeCalls(std::uint32_t fn) const {
+        return this->compiled[fn];
+    }
+
+  private:
+    // untouched pages of these cost nothing, so they can be generous
+    static constexpr std::size_t maxRegisters = std::size_t(1) << 22;
+    static constexpr std::size_t maxFrames = std::size_t(1) << 18;
+
+    struct Frame {
+        const Instr *pc; // where to resume the caller
+        Slot *base;
+        const BytecodeFunction *fn;
+    };
+
+    const BytecodeModule &module;
+    std::vector<Slot> globals;
+    std::unique_ptr<Slot[]> registers;
+    std::unique_ptr<Frame[]> frames;
+
+    std::unique_ptr<std::atomic<NativeFn>[]> native;
+    std::vector<std::uint64_t> interpreted;
+    std::vector<std::uint64_t> compiled;
+    std::uint64_t threshold = 0; // 0 = never
+    std::function<void(std::uint32_t)> onHot;
+
+    [[noreturn]] static void fail(const std::string &what,
+                                  const BytecodeFunction &fn);
+};
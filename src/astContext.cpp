@@ -0,0 +1,222 @@
+#include "ast.hpp"
+#include "astContext.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <variant>
+
+NodeId ASTContext::addLiteral(Literal value) {
+    NodeId *shared = nullptr;
+    if (this->hashConsed) {
+        // the key holds the value itself: op is the variant index and a/b
+        // the bits of the int, double or bool
+        Literal::Value v = value.get();
+        Node key{NodeKind::Literal, static_cast<std::uint8_t>(v.index()), 0,
+                 0};
+        std::visit(
+            [&key](auto arg) {
+                std::uint64_t bits = 0;
+                std::memcpy(&bits, &arg, sizeof(arg));
+                key.a = static_cast<std::uint32_t>(bits);
+                key.b = static_cast<std::uint32_t>(bits >> 32);
+            },
+            v);
+
+        auto [it, inserted] = this->uniqueNodes.try_emplace(key, noNode);
+        if (!inserted) {
+            return it->second;
+        }
+        shared = &it->second;
+    }
+
+    std::uint32_t index = static_cast<std::uint32_t>(this->literals.size());
+    this->literals.push_back(value);
+    NodeId id = this->push({NodeKind::Literal, 0, index, 0});
+    if (shared) {
+        *shared = id;
+    }
+    return id;
+}
+
+NodeId ASTContext::addVariable(Symbol name) {
+    return this->pushUnique({NodeKind::Variable, 0, name, 0});
+}
+
+NodeId ASTContext::addBinary(BinaryOp op, NodeId lhs, NodeId rhs) {
+    return this->pushUnique(
+        {NodeKind::Binary, static_cast<std::uint8_t>(op), lhs, rhs});
+}
+
+NodeId ASTContext::addUnary(UnaryOp op, NodeId operand) {
+    return this->pushUnique(
+        {NodeKind::Unary, static_cast<std::uint8_t>(op), operand, 0});
+}
+
+NodeId ASTContext::addCall(Symbol callee, const NodeId *args,
+                           std::size_t count) {
+    return this->push(
+        {NodeKind::Call, 0, callee, this->pushList(args, count)});
+}
+
+NodeId ASTContext::addExpressionStmt(NodeId expr) {
+    return this->push({NodeKind::ExpressionStmt, 0, expr, 0});
+}
+
+NodeId ASTContext::addBlock(const NodeId *stmts, std::size_t count) {
+    return this->push({NodeKind::Block, 0, this->pushList(stmts, count), 0});
+}
+
+NodeId ASTContext::addFn(Symbol name, const FnParam *params,
+                         std::size_t count, Type retType, NodeId body) {
+    std::uint32_t index = static_cast<std::uint32_t>(this->fns.size());
+    std::uint32_t first = static_cast<std::uint32_t>(this->fnParams.size());
+    this->fnParams.insert(this->fnParams.end(), params, params + count);
+    this->fns.push_back({name, retType, first,
+                         static_cast<std::uint32_t>(count), body});
+    return this->push({NodeKind::Fn, 0, index, 0});
+}
+
+NodeId ASTContext::addLet(Symbol name, bool mut, Type type,
+                          NodeId initializer) {
+    std::uint32_t index = static_cast<std::uint32_t>(this->lets.size());
+    this->lets.push_back({name, mut, type, initializer});
+    return this->push({NodeKind::Let, 0, index, 0});
+}
+
+NodeId ASTContext::addReturn(NodeId value) {
+    return this->push({NodeKind::Return, 0, value, 0});
+}
+
+NodeId ASTContext::addProgram(const NodeId *stmts, std::size_t count) {
+    return this->push(
+        {NodeKind::Program, 0, this->pushList(stmts, count), 0});
+}
+
+NodeId ASTContext::append(const ASTContext &other) {
+    if (this->nodes.size() + other.nodes.size() >= noNode) {
+        throw std::runtime_error("Too many AST nodes");
+    }
+
+    std::uint32_t nodeBase = static_cast<std::uint32_t>(this->nodes.size());
+    std::uint32_t literalBase =
+        static_cast<std::uint32_t>(this->literals.size());
+    std::uint32_t fnBase = static_cast<std::uint32_t>(this->fns.size());
+    std::uint32_t paramBase = static_cast<std::uint32_t>(this->fnParams.size());
+    std::uint32_t letBase = static_cast<std::uint32_t>(this->lets.size());
+    std::uint32_t listBase = static_cast<std::uint32_t>(this->lists.size());
+
+    auto relocate = [nodeBase](NodeId id) {
+        return id == noNode ? noNode : id + nodeBase;
+    };
+
+    this->nodes.reserve(this->nodes.size() + other.nodes.size());
+    for (Node node : other.nodes) {
+        switch (node.kind) {
+        case NodeKind::Literal:
+            node.a += literalBase;
+            break;
+        case NodeKind::Variable:
+            break;
+        case NodeKind::Binary:
+            node.a = relocate(node.a);
+            node.b = relocate(node.b);
+            break;
+        case NodeKind::Unary:
+        case NodeKind::ExpressionStmt:
+        case NodeKind::Return:
+            node.a = relocate(node.a);
+            break;
+        case NodeKind::Call:
+            node.b += listBase;
+            break;
+        case NodeKind::Block:
+        case NodeKind::Program:
+            node.a += listBase;
+            break;
+        case NodeKind::Fn:
+            node.a += fnBase;
+            break;
+        case NodeKind::Let:
+            node.a += letBase;
+            break;
+        }
+        this->nodes.push_back(node);
+    }
+
+    this->literals.insert(this->literals.end(), other.literals.begin(),
+                          other.literals.end());
+    this->fnParams.insert(this->fnParams.end(), other.fnParams.begin(),
+                          other.fnParams.end());
+
+    for (FnDecl fn : other.fns) {
+        fn.firstParam += paramBase;
+        fn.body = relocate(fn.body);
+        this->fns.push_back(fn);
+    }
+    for (LetDecl let : other.lets) {
+        let.initializer = relocate(let.initializer);
+        this->lets.push_back(let);
+    }
+
+    // each list is its length followed by that many ids
+    this->lists.reserve(this->lists.size() + other.lists.size());
+    for (std::size_t i = 0; i < other.lists.size();) {
+        NodeId count = other.lists[i++];
+        this->lists.push_back(count);
+        for (NodeId end = static_cast<NodeId>(i) + count; i < end; ++i) {
+            this->lists.push_back(relocate(other.lists[i]));
+        }
+    }
+
+    return nodeBase;
+}
+
+void ASTContext::closeSharingScope() {
+    if (this->uniqueNodes.empty()) {
+        return;
+    }
+    // clear() touches every bucket, so drop the table after a large scope
+    // rather than paying for its buckets on each small one that follows
+    if (this->uniqueNodes.bucket_count() > 4 * this->uniqueNodes.size() + 64) {
+        this->uniqueNodes = {};
+    } else {
+        this->uniqueNodes.clear();
+    }
+}
+
+NodeId ASTContext::push(Node node) {
+    // noNode is reserved
+    if (this->nodes.size() >= noNode) {
+        throw std::runtime_error("Too many AST nodes");
+    }
+    NodeId id = static_cast<NodeId>(this->nodes.size());
+    this->nodes.push_back(node);
+    return id;
+}
+
+NodeId ASTContext::pushUnique(Node node) {
+    if (!this->hashConsed) {
+        return this->push(node);
+    }
+    auto [it, inserted] = this->uniqueNodes.try_emplace(node, noNode);
+    if (inserted) {
+        it->second = this->push(node);
+    }
+    return it->second;
+}
+
+std::size_t ASTContext::NodeHash::operator()(const Node &node) const {
+    std::uint64_t h = (std::uint64_t(node.a) << 32 | node.b) ^
+                      (std::uint64_t(node.kind) << 8 | node.op);
+    h *= 0x9e3779b97f4a7c15ULL;
+    return static_cast<std::size_t>(h ^ (h >> 32));
+}
+
+std::uint32_t ASTContext::pushList(const NodeId *items, std::size_t count) {
+    std::uint32_t at = static_cast<std::uint32_t>(this->lists.size());
+    this->lists.push_back(static_cast<NodeId>(count));
+    this->lists.insert(this->lists.end(), items, items + count);
+    return at;
+}
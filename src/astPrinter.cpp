@@ -1,164 +1,217 @@
 #include "ast.hpp"
+#include "astContext.hpp"
 #include "astPrinter.hpp"
+#include "interner.hpp"
 
 #include <iostream>
 #include <variant>
-
-void ASTPrinter::visit(LiteralExpr &expr) {
-    std::visit([&](auto &&value) { std::cout << value; }, expr.value.get());
+#include <vector>
+
+void ASTPrinter::print(NodeId id) {
+    switch (this->ast.kind(id)) {
+    case NodeKind::Literal:
+    case NodeKind::Variable:
+    case NodeKind::Binary:
+    case NodeKind::Unary:
+    case NodeKind::Call:
+        return this->printExpr(id);
+    case NodeKind::ExpressionStmt:
+        return this->printExpressionStmt(id);
+    case NodeKind::Block:
+        return this->printBlock(id);
+    case NodeKind::Fn:
+        return this->printFn(id);
+    case NodeKind::Let:
+        return this->printLet(id);
+    case NodeKind::Return:
+        return this->printReturn(id);
+    case NodeKind::Program:
+        return this->printProgram(id);
+    }
 }
 
-void ASTPrinter::visit(VariableExpr &expr) { std::cout << expr.name; }
-
-void ASTPrinter::visit(BinaryExpr &expr) {
-    std::cout << "(";
-    expr.lhs->accept(*this);
+namespace {
 
-    switch (expr.op) {
+const char *binaryOpText(BinaryOp op) {
+    switch (op) {
     case BinaryOp::Add:
-        std::cout << " + ";
-        break;
+        return " + ";
     case BinaryOp::Sub:
-        std::cout << " - ";
-        break;
+        return " - ";
     case BinaryOp::Mul:
-        std::cout << " * ";
-        break;
+        return " * ";
     case BinaryOp::Div:
-        std::cout << " / ";
-        break;
+        return " / ";
     case BinaryOp::Mod:
-        std::cout << " % ";
-        break;
+        return " % ";
     case BinaryOp::Eq:
-        std::cout << " == ";
-        break;
+        return " == ";
     case BinaryOp::Neq:
-        std::cout << " != ";
-        break;
+        return " != ";
     case BinaryOp::Lt:
-        std::cout << " < ";
-        break;
+        return " < ";
     case BinaryOp::Lte:
-        std::cout << " <= ";
-        break;
+        return " <= ";
     case BinaryOp::Gt:
-        std::cout << " > ";
-        break;
+        return " > ";
     case BinaryOp::Gte:
-        std::cout << " >= ";
-        break;
+        return " >= ";
     }
-
-    expr.rhs->accept(*this);
-    std::cout << ")";
+    return "";
 }
 
-void ASTPrinter::visit(UnaryExpr &expr) {
-    switch (expr.op) {
-    case UnaryOp::Negate:
-        std::cout << "-";
-        break;
-    case UnaryOp::Not:
-        std::cout << "!";
-        break;
-    }
-
-    expr.operand->accept(*this);
-}
+} // namespace
+
+// Walks the expression with an explicit stack of what is left to print, so
+// deeply nested expressions do not exhaust the native stack.
+void ASTPrinter::printExpr(NodeId root) {
+    struct Item {
+        NodeId id;
+        const char *text; // printed instead of a node when set
+    };
+    std::vector<Item> todo{{root, nullptr}};
+
+    while (!todo.empty()) {
+        Item item = todo.back();
+        todo.pop_back();
+        if (item.text) {
+            this->os << item.text;
+            continue;
+        }
 
-void ASTPrinter::visit(CallExpr &expr) {
-    std::cout << expr.callee << "(";
-    for (size_t i = 0; i < expr.args.size(); ++i) {
-        expr.args[i]->accept(*this);
-        if (i + 1 < expr.args.size()) {
-            std::cout << ", ";
+        NodeId id = item.id;
+        switch (this->ast.kind(id)) {
+        case NodeKind::Literal:
+            std::visit([&](auto &&value) { this->os << value; },
+                       this->ast.literal(id).get());
+            break;
+        case NodeKind::Variable:
+            this->os << this->interner.spelling(this->ast.variable(id));
+            break;
+        case NodeKind::Binary:
+            this->os << "(";
+            todo.push_back({noNode, ")"});
+            todo.push_back({this->ast.rhs(id), nullptr});
+            todo.push_back({noNode, binaryOpText(this->ast.binaryOp(id))});
+            todo.push_back({this->ast.lhs(id), nullptr});
+            break;
+        case NodeKind::Unary:
+            switch (this->ast.unaryOp(id)) {
+            case UnaryOp::Negate:
+                this->os << "-";
+                break;
+            case UnaryOp::Not:
+                this->os << "!";
+                break;
+            }
+            todo.push_back({this->ast.operand(id), nullptr});
+            break;
+        case NodeKind::Call: {
+            NodeList<NodeId> args = this->ast.args(id);
+            this->os << this->interner.spelling(this->ast.callee(id)) << "(";
+            todo.push_back({noNode, ")"});
+            for (size_t i = args.size(); i-- > 0;) {
+                todo.push_back({args[i], nullptr});
+                if (i > 0) {
+                    todo.push_back({noNode, ", "});
+                }
+            }
+            break;
+        }
+        default:
+            this->print(id);
+            break;
         }
     }
-    std::cout << ")";
 }
 
 /////
 
-void ASTPrinter::visit(ExpressionStmt &stmt) {
+void ASTPrinter::printExpressionStmt(NodeId id) {
     this->printIndent();
-    if (stmt.expr) {
-        stmt.expr->accept(*this);
+    if (this->ast.expr(id) != noNode) {
+        this->print(this->ast.expr(id));
     }
-    std::cout << ";" << std::endl;
+    this->os << ";" << std::endl;
 }
 
-void ASTPrinter::visit(BlockStmt &stmt) {
+void ASTPrinter::printBlock(NodeId id) {
     this->printIndent();
-    std::cout << "{" << std::endl;
+    this->os << "{" << std::endl;
     ++indentLevel;
-    for (const auto &s : stmt.stmts) {
-        s->accept(*this);
+    for (NodeId s : this->ast.stmts(id)) {
+        this->print(s);
     }
     --indentLevel;
     this->printIndent();
-    std::cout << "}" << std::endl;
+    this->os << "}" << std::endl;
 }
 
-void ASTPrinter::visit(FnStmt &stmt) {
+void ASTPrinter::printFn(NodeId id) {
+    const FnDecl &fn = this->ast.fn(id);
+    NodeList<FnParam> params = this->ast.params(fn);
     this->printIndent();
-    std::cout << "fn " << stmt.name << "(";
-    for (size_t i = 0; i < stmt.params.size(); ++i) {
-        std::cout << stmt.params[i].name << ": " << stmt.params[i].type.kind;
-        if (i + 1 < stmt.params.size()) {
-            std::cout << ", ";
+    this->os << "fn " << this->interner.spelling(fn.name) << "(";
+    for (size_t i = 0; i < params.size(); ++i) {
+        this->os << this->interner.spelling(params[i].name) << ": "
+                  << params[i].type.kind;
+        if (i + 1 < params.size()) {
+            this->os << ", ";
         }
     }
-    std::cout << ") -> " << stmt.retType.kind << " ";
-    stmt.body->accept(*this);
-    std::cout << std::endl;
+    this->os << ") -> " << fn.retType.kind << " ";
+    this->print(fn.body);
+    this->os << std::endl;
 }
 
-void ASTPrinter::visit(LetStmt &stmt) {
+void ASTPrinter::printLet(NodeId id) {
+    const LetDecl &let = this->ast.let(id);
     this->printIndent();
-    std::cout << "let " << (stmt.mut ? "mut " : "const ") << stmt.name << ": "
-              << stmt.type.kind << " = ";
-    if (dynamic_cast<LiteralExpr *>(stmt.initializer.get())) {
-        stmt.initializer->accept(*this);
-        std::cout << ";" << std::endl;
+    this->os << "let " << (let.mut ? "mut " : "const ")
+              << this->interner.spelling(let.name) << ": " << let.type.kind
+              << " = ";
+    if (this->ast.kind(let.initializer) == NodeKind::Literal) {
+        this->print(let.initializer);
+        this->os << ";" << std::endl;
     } else {
-        std::cout << std::endl;
+        this->os << std::endl;
         ++indentLevel;
         this->printIndent();
-        stmt.initializer->accept(*this);
+        this->print(let.initializer);
         --indentLevel;
-        std::cout << ";" << std::endl;
+        this->os << ";" << std::endl;
     }
 }
 
-void ASTPrinter::visit(ReturnStmt &stmt) {
+void ASTPrinter::printReturn(NodeId id) {
+    NodeId value = this->ast.returnValue(id);
     this->printIndent();
-    if (stmt.value.has_value()) {
-        std::cout << "return ";
-        if (dynamic_cast<LiteralExpr *>(stmt.value->get())) {
-            stmt.value->get()->accept(*this);
-            std::cout << ";" << std::endl;
+    if (value != noNode) {
+        this->os << "return ";
+        if (this->ast.kind(value) == NodeKind::Literal) {
+            this->print(value);
+            this->os << ";" << std::endl;
         } else {
-            std::cout << std::endl;
+            this->os << std::endl;
             ++indentLevel;
             this->printIndent();
-            stmt.value->get()->accept(*this);
+            this->print(value);
             --indentLevel;
-            std::cout << ";" << std::endl;
+            this->os << ";" << std::endl;
         }
     } else {
-        std::cout << "return;" << std::endl;
+        this->os << "return;" << std::endl;
     }
 }
 
-void ASTPrinter::visit(Program &stmt) {
-    for (const auto &s : stmt.stmts) {
-        s->accept(*this);
+void ASTPrinter::printProgram(NodeId id) {
+    for (NodeId s : this->ast.stmts(id)) {
+        this->print(s);
     }
 }
 
 void ASTPrinter::printIndent() const {
     for (int i = 0; i < this->indentLevel; ++i) {
-        std::cout << "  ";
+        this->os << "  ";
     }
 }
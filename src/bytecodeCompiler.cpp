@@ -0,0 +1,602 @@
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "bytecode.hpp"
+#include "bytecodeCompiler.hpp"
+#include "literal.hpp"
+#include "type.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <variant>
+
+namespace {
+
+const char *typeName(PrimitiveType type) {
+    switch (type) {
+    case PrimitiveType::Void:
+        return "void";
+    case PrimitiveType::I32:
+        return "i32";
+    case PrimitiveType::F64:
+        return "f64";
+    case PrimitiveType::Bool:
+        return "bool";
+    default:
+        return "unknown";
+    }
+}
+
+Op intOp(BinaryOp op) {
+    switch (op) {
+    case BinaryOp::Add:
+        return Op::AddI;
+    case BinaryOp::Sub:
+        return Op::SubI;
+    case BinaryOp::Mul:
+        return Op::MulI;
+    case BinaryOp::Div:
+        return Op::DivI;
+    case BinaryOp::Mod:
+        return Op::ModI;
+    case BinaryOp::Eq:
+        return Op::EqI;
+    case BinaryOp::Neq:
+        return Op::NeI;
+    case BinaryOp::Lt:
+        return Op::LtI;
+    case BinaryOp::Lte:
+        return Op::LeI;
+    case BinaryOp::Gt:
+        return Op::GtI;
+    case BinaryOp::Gte:
+        return Op::GeI;
+    }
+    return Op::AddI;
+}
+
+Op floatOp(BinaryOp op) {
+    switch (op) {
+    case BinaryOp::Add:
+        return Op::AddF;
+    case BinaryOp::Sub:
+        return Op::SubF;
+    case BinaryOp::Mul:
+        return Op::MulF;
+    case BinaryOp::Div:
+        return Op::DivF;
+    case BinaryOp::Mod:
+        return Op::ModF;
+    case BinaryOp::Eq:
+        return Op::EqF;
+    case BinaryOp::Neq:
+        return Op::NeF;
+    case BinaryOp::Lt:
+        return Op::LtF;
+    case BinaryOp::Lte:
+        return Op::LeF;
+    case BinaryOp::Gt:
+        return Op::GtF;
+    case BinaryOp::Gte:
+        return Op::GeF;
+    }
+    return Op::AddF;
+}
+
+bool isComparison(BinaryOp op) {
+    return op != BinaryOp::Add && op != BinaryOp::Sub &&
+           op != BinaryOp::Mul && op != BinaryOp::Div && op != BinaryOp::Mod;
+}
+
+} // namespace
+
+BytecodeModule BytecodeCompiler::compile(NodeId program) {
+    this->module = BytecodeModule();
+    this->functions.clear();
+    this->globals.clear();
+
+    // like codegen, every function and global is declared before any body
+    // is compiled, so functions can call each other in any order
+    bool hasMain = false;
+    for (NodeId stmt : this->ast.stmts(program)) {
+        if (this->ast.kind(stmt) == NodeKind::Fn) {
+            const FnDecl &fn = this->ast.fn(stmt);
+            auto index =
+                static_cast<std::uint32_t>(this->module.functions.size());
+            if (!this->functions.insert({fn.name, {index, &fn}}).second) {
+                this->error("Function '" + this->spelling(fn.name) +
+                            "' is defined more than once");
+            }
+            this->module.functions.emplace_back();
+            this->module.functions.back().name = this->spelling(fn.name);
+            if (this->module.functions.back().name == "main") {
+                this->module.mainIndex = index;
+                hasMain = true;
+            }
+        } else if (this->ast.kind(stmt) == NodeKind::Let) {
+            this->declareGlobal(this->ast.let(stmt));
+        } else {
+            this->error("Only functions and variable declarations can be "
+                        "declared at top level");
+        }
+    }
+    if (!hasMain) {
+        this->error("Program is missing 'fn main(): void");
+    }
+
+    for (NodeId stmt : this->ast.stmts(program)) {
+        if (this->ast.kind(stmt) == NodeKind::Fn) {
+            const FnDecl &fn = this->ast.fn(stmt);
+            std::uint32_t index = this->functions.at(fn.name).index;
+            this->out = &this->module.functions[index];
+            this->compileFn(fn);
+        }
+    }
+    this->out = nullptr;
+
+    return std::move(this->module);
+}
+
+void BytecodeCompiler::declareGlobal(const LetDecl &let) {
+    Slot value{};
+    PrimitiveType type = let.type.kind;
+
+    if (let.initializer != noNode) {
+        // the folder has already reduced every constant initializer
+        if (this->ast.kind(let.initializer) != NodeKind::Literal) {
+            this->error("Global variable initializer must be constant");
+        }
+        Literal::Value init = this->ast.literal(let.initializer).get();
+        PrimitiveType initType = PrimitiveType::Unknown;
+        if (const int *i = std::get_if<int>(&init)) {
+            value.i = *i;
+            initType = PrimitiveType::I32;
+        } else if (const double *d = std::get_if<double>(&init)) {
+            value.f = *d;
+            initType = PrimitiveType::F64;
+        } else {
+            value.i = std::get<bool>(init);
+            initType = PrimitiveType::Bool;
+        }
+        if (initType != type) {
+            this->error("Type mismatch: global '" + this->spelling(let.name) +
+                        "' is declared '" + typeName(type) +
+                        "' but initialized with '" + typeName(initType) + "'");
+        }
+    } else if (type == PrimitiveType::F64) {
+        value.f = 0.0;
+    }
+
+    auto index = static_cast<std::uint32_t>(this->module.globals.size());
+    this->module.globals.push_back(value);
+    this->globals.insert_or_assign(let.name, GlobalInfo{index, type});
+}
+
+void BytecodeCompiler::compileFn(const FnDecl &fn) {
+    this->fn = &fn;
+    this->returned = false;
+    this->locals.clear();
+    this->intConstants.clear();
+    this->floatConstants.clear();
+
+    // main returns i32 to the host even when it is void in the source
+    bool isMain = this->spelling(fn.name) == "main";
+    this->retType = isMain ? PrimitiveType::I32 : fn.retType.kind;
+
+    NodeList<FnParam> params = this->ast.params(fn);
+    this->firstTemp = 0;
+    this->nextReg = 0;
+    for (const FnParam &param : params) {
+        this->locals.insert_or_assign(
+            param.name, Operand{this->allocate(), param.type.kind});
+    }
+    this->firstTemp = this->nextReg;
+
+    this->compileStmt(fn.body);
+
+    if (!this->returned) {
+        if (!isMain && fn.retType.kind != PrimitiveType::Void) {
+            this->error("Function '" + this->spelling(fn.name) +
+                        "' does not return a value");
+        }
+        this->emit(Op::RetVoid, 0);
+    }
+    this->fn = nullptr;
+}
+
+void BytecodeCompiler::compileStmt(NodeId id) {
+    switch (this->ast.kind(id)) {
+    case NodeKind::Literal:
+    case NodeKind::Variable:
+    case NodeKind::Binary:
+    case NodeKind::Unary:
+    case NodeKind::Call:
+        this->compileExpr(id);
+        this->nextReg = this->firstTemp;
+        break;
+    case NodeKind::ExpressionStmt:
+        if (this->ast.expr(id) != noNode) {
+            this->compileExpr(this->ast.expr(id));
+            this->nextReg = this->firstTemp;
+        }
+        break;
+    case NodeKind::Block:
+        for (NodeId stmt : this->ast.stmts(id)) {
+            this->compileStmt(stmt);
+        }
+        break;
+    case NodeKind::Fn:
+        this->error("Function '" + this->spelling(this->ast.fn(id).name) +
+                    "' must be declared at top level");
+    case NodeKind::Let:
+        this->compileLet(id);
+        break;
+    case NodeKind::Return:
+        this->compileReturn(id);
+        break;
+    case NodeKind::Program:
+        this->error("Program node inside a program");
+    }
+}
+
+void BytecodeCompiler::compileLet(NodeId id) {
+    const LetDecl &let = this->ast.let(id);
+    PrimitiveType type = let.type.kind;
+
+    Operand value{0, PrimitiveType::Void};
+    if (let.initializer != noNode) {
+        value = this->compileExpr(let.initializer);
+    } else if (type == PrimitiveType::I32) {
+        value = this->compileLiteral(Literal(0));
+    } else if (type == PrimitiveType::F64) {
+        value = this->compileLiteral(Literal(0.0));
+    } else if (type == PrimitiveType::Bool) {
+        value = this->compileLiteral(Literal(false));
+    } else {
+        this->error("Unexpected type");
+    }
+
+    if (value.type != type) {
+        this->error("Type mismatch in function '" +
+                    this->spelling(this->fn->name) + "': '" +
+                    this->spelling(let.name) + "' is declared '" +
+                    typeName(type) + "' but initialized with '" +
+                    typeName(value.type) + "'");
+    }
+
+    // a value computed for this let is left where it is; an immutable let
+    // of another variable is that variable, as in the SSA codegen emits
+    if (value.reg < this->firstTemp && let.mut) {
+        std::uint16_t reg = this->allocate();
+        this->emit(Op::Move, reg, value.reg);
+        value.reg = reg;
+    }
+    this->locals.insert_or_assign(let.name, value);
+    this->firstTemp = this->nextReg;
+}
+
+void BytecodeCompiler::compileReturn(NodeId id) {
+    NodeId value = this->ast.returnValue(id);
+    std::string name = this->spelling(this->fn->name);
+    this->returned = true;
+
+    if (value == noNode) {
+        if (this->fn->retType.kind != PrimitiveType::Void &&
+            name != "main") {
+            this->error("Empty return in function with non-void return type.");
+        }
+        this->emit(Op::RetVoid, 0);
+        return;
+    }
+
+    if (this->fn->retType.kind == PrimitiveType::Void) {
+        this->error("Error in function '" + name +
+                    "': cannot return a value from a void function.");
+    }
+    Operand result = this->compileExpr(value);
+    if (result.type != this->retType) {
+        this->error("Type mismatch in function '" + name + "': returning '" +
+                    typeName(result.type) + "' but expected '" +
+                    typeName(this->retType) + "'");
+    }
+    this->emit(Op::Ret, result.reg);
+    this->nextReg = this->firstTemp;
+}
+
+// Post-order over an explicit stack like the other expression walks. Each
+// visited node leaves the register holding its value; a variable's value is
+// its own register, so reading a local costs no instruction.
+BytecodeCompiler::Operand BytecodeCompiler::compileExpr(NodeId root) {
+    std::size_t base = this->pendingExprs.size();
+    this->pendingExprs.push_back({root, false, 0});
+
+    while (this->pendingExprs.size() > base) {
+        PendingExpr top = this->pendingExprs.back();
+
+        // a call argument has just been computed; make sure it sits in the
+        // register the call expects it in
+        if (top.id == noNode) {
+            this->pendingExprs.pop_back();
+            Operand &arg = this->operands.back();
+            if (arg.reg != top.reg) {
+                std::uint16_t reg = this->allocate();
+                this->emit(Op::Move, reg, arg.reg);
+                arg.reg = reg;
+            }
+            continue;
+        }
+
+        NodeKind kind = this->ast.kind(top.id);
+        if (!top.expanded) {
+            if (kind == NodeKind::Binary) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.push_back({this->ast.rhs(top.id), false, 0});
+                this->pendingExprs.push_back({this->ast.lhs(top.id), false, 0});
+                continue;
+            }
+            if (kind == NodeKind::Unary) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.push_back(
+                    {this->ast.operand(top.id), false, 0});
+                continue;
+            }
+            if (kind == NodeKind::Call) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.back().reg = this->nextReg;
+                NodeList<NodeId> args = this->ast.args(top.id);
+                for (std::size_t i = args.size(); i-- > 0;) {
+                    this->pendingExprs.push_back(
+                        {noNode, false,
+                         this->nextReg + static_cast<std::uint32_t>(i)});
+                    this->pendingExprs.push_back({args[i], false, 0});
+                }
+                continue;
+            }
+        }
+        this->pendingExprs.pop_back();
+
+        Operand result{0, PrimitiveType::Void};
+        switch (kind) {
+        case NodeKind::Literal:
+            result = this->compileLiteral(this->ast.literal(top.id));
+            break;
+        case NodeKind::Variable:
+            result = this->compileVariable(top.id);
+            break;
+        case NodeKind::Binary: {
+            Operand rhs = this->operands.back();
+            this->operands.pop_back();
+            Operand lhs = this->operands.back();
+            this->operands.pop_back();
+            result = this->compileBinary(top.id, lhs, rhs);
+            break;
+        }
+        case NodeKind::Unary: {
+            Operand operand = this->operands.back();
+            this->operands.pop_back();
+            result = this->compileUnary(top.id, operand);
+            break;
+        }
+        case NodeKind::Call:
+            result = this->compileCall(top.id, top.reg);
+            break;
+        default:
+            this->error("Expected an expression");
+        }
+        this->operands.push_back(result);
+    }
+
+    Operand result = this->operands.back();
+    this->operands.pop_back();
+    return result;
+}
+
+BytecodeCompiler::Operand
+BytecodeCompiler::compileLiteral(const Literal &literal) {
+    Literal::Value value = literal.get();
+    Slot slot{};
+    PrimitiveType type = PrimitiveType::I32;
+    std::uint32_t index = 0;
+
+    if (const double *d = std::get_if<double>(&value)) {
+        slot.f = *d;
+        type = PrimitiveType::F64;
+        std::uint64_t bits = 0;
+        std::memcpy(&bits, d, sizeof bits);
+        auto [found, inserted] = this->floatConstants.insert(
+            {bits, static_cast<std::uint32_t>(this->out->constants.size())});
+        index = found->second;
+        if (inserted) {
+            this->out->constants.push_back(slot);
+        }
+    } else {
+        if (const bool *b = std::get_if<bool>(&value)) {
+            slot.i = *b;
+            type = PrimitiveType::Bool;
+        } else {
+            slot.i = std::get<int>(value);
+        }
+        auto [found, inserted] = this->intConstants.insert(
+            {slot.i, static_cast<std::uint32_t>(this->out->constants.size())});
+        index = found->second;
+        if (inserted) {
+            this->out->constants.push_back(slot);
+        }
+    }
+
+    std::uint16_t reg = this->allocate();
+    this->emitIndexed(Op::LoadConst, reg, index);
+    return {reg, type};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compileVariable(NodeId id) {
+    Symbol name = this->ast.variable(id);
+
+    auto local = this->locals.find(name);
+    if (local != this->locals.end()) {
+        return local->second;
+    }
+
+    auto global = this->globals.find(name);
+    if (global == this->globals.end()) {
+        this->error("Undefined variable: " + this->spelling(name));
+    }
+    std::uint16_t reg = this->allocate();
+    this->emitIndexed(Op::LoadGlobal, reg, global->second.index);
+    return {reg, global->second.type};
+}
+
+BytecodeCompiler::Operand
+BytecodeCompiler::compileBinary(NodeId id, Operand lhs, Operand rhs) {
+    BinaryOp op = this->ast.binaryOp(id);
+    this->release(rhs);
+    this->release(lhs);
+
+    if (lhs.type != rhs.type) {
+        this->error("Operands of different types '" +
+                    std::string(typeName(lhs.type)) + "' and '" +
+                    typeName(rhs.type) + "' in function '" +
+                    this->spelling(this->fn->name) + "'");
+    }
+
+    Op code = Op::AddI;
+    switch (lhs.type) {
+    case PrimitiveType::I32:
+        code = intOp(op);
+        break;
+    case PrimitiveType::F64:
+        code = floatOp(op);
+        break;
+    case PrimitiveType::Bool:
+        if (!isComparison(op)) {
+            this->error("Arithmetic on bool in function '" +
+                        this->spelling(this->fn->name) + "'");
+        }
+        code = intOp(op);
+        // codegen compares i1 as signed, where true is -1
+        if (op != BinaryOp::Eq && op != BinaryOp::Neq) {
+            std::swap(lhs, rhs);
+        }
+        break;
+    default:
+        this->error("Operands of type '" + std::string(typeName(lhs.type)) +
+                    "' in function '" + this->spelling(this->fn->name) + "'");
+    }
+
+    std::uint16_t reg = this->allocate();
+    this->emit(code, reg, lhs.reg, rhs.reg);
+    return {reg, isComparison(op) ? PrimitiveType::Bool : lhs.type};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compileUnary(NodeId id,
+                                                         Operand operand) {
+    this->release(operand);
+
+    Op code = Op::Not;
+    switch (this->ast.unaryOp(id)) {
+    case UnaryOp::Negate:
+        if (operand.type == PrimitiveType::F64) {
+            code = Op::NegF;
+        } else if (operand.type == PrimitiveType::I32) {
+            code = Op::NegI;
+        } else {
+            this->error("Operator '-' expects a number");
+        }
+        break;
+    case UnaryOp::Not:
+        if (operand.type != PrimitiveType::Bool) {
+            this->error("Operator '!' expects a bool");
+        }
+        break;
+    }
+
+    std::uint16_t reg = this->allocate();
+    this->emit(code, reg, operand.reg);
+    return {reg, operand.type};
+}
+
+// The arguments are already in consecutive registers from `base`, which is
+// where the callee's window starts and where its result ends up.
+BytecodeCompiler::Operand BytecodeCompiler::compileCall(NodeId id,
+                                                        std::uint32_t base) {
+    Symbol callee = this->ast.callee(id);
+    auto found = this->functions.find(callee);
+    if (found == this->functions.end()) {
+        this->error("Unknown function '" + this->spelling(callee) + "'");
+    }
+    const FnDecl &decl = *found->second.decl;
+
+    NodeList<FnParam> params = this->ast.params(decl);
+    std::size_t count = this->ast.args(id).size();
+    if (params.size() != count) {
+        this->error("Wrong number of arguments in call to function '" +
+                    this->spelling(callee) + "'");
+    }
+
+    std::size_t first = this->operands.size() - count;
+    for (std::size_t i = 0; i < count; ++i) {
+        PrimitiveType type = this->operands[first + i].type;
+        if (type != params[i].type.kind) {
+            this->error("Argument " + std::to_string(i + 1) +
+                        " in call to function '" + this->spelling(callee) +
+                        "' is '" + typeName(type) + "' but expected '" +
+                        typeName(params[i].type.kind) + "'");
+        }
+    }
+    this->operands.resize(first);
+
+    this->emitIndexed(Op::Call, static_cast<std::uint16_t>(base),
+                      found->second.index);
+    this->nextReg = base;
+
+    PrimitiveType type = this->spelling(callee) == "main"
+                             ? PrimitiveType::I32
+                             : decl.retType.kind;
+    if (type == PrimitiveType::Void) {
+        return {static_cast<std::uint16_t>(base), type};
+    }
+    return {this->allocate(), type};
+}
+
+std::uint16_t BytecodeCompiler::allocate() {
+    if (this->nextReg >= maxRegisters) {
+        this->error("Function '" + this->spelling(this->fn->name) +
+                    "' needs more than " + std::to_string(maxRegisters) +
+                    " registers");
+    }
+    auto reg = static_cast<std::uint16_t>(this->nextReg++);
+    this->out->registerCount =
+        std::max(this->out->registerCount, this->nextReg);
+    return reg;
+}
+
+// Temporaries are released in the reverse order they were allocated in, so
+// the one being released is always the topmost.
+void BytecodeCompiler::release(Operand operand) {
+    if (operand.reg >= this->firstTemp) {
+        this->nextReg = operand.reg;
+    }
+}
+
+void BytecodeCompiler::emit(Op op, std::uint32_t a, std::uint32_t b,
+                            std::uint32_t c) {
+    this->out->code.push_back({op, static_cast<std::uint16_t>(a),
+                               static_cast<std::uint16_t>(b),
+                               static_cast<std::uint16_t>(c)});
+}
+
+void BytecodeCompiler::emitIndexed(Op op, std::uint16_t a,
+                                   std::uint32_t index) {
+    this->emit(op, a, index & 0xffff, index >> 16);
+}
+
+void BytecodeCompiler::error(const std::string &what) const {
+    throw std::runtime_error(what);
+}
+
+std::string BytecodeCompiler::spelling(Symbol name) const {
+    return std::string(this->interner.spelling(name));
+}
@@ -0,0 +1,218 @@
+#include "charScan.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SLUG_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool isAlnum(char c) {
+    char lower = c | 0x20;
+    return isDigit(c) || (lower >= 'a' && lower <= 'z');
+}
+
+std::size_t whitespaceScalar(const char *begin, const char *end,
+                             int &newlines) {
+    const char *p = begin;
+    while (p < end && isWhitespace(*p)) {
+        newlines += *p == '\n';
+        ++p;
+    }
+    return p - begin;
+}
+
+std::size_t alnumScalar(const char *begin, const char *end) {
+    const char *p = begin;
+    while (p < end && isAlnum(*p)) {
+        ++p;
+    }
+    return p - begin;
+}
+
+std::size_t digitsScalar(const char *begin, const char *end) {
+    const char *p = begin;
+    while (p < end && isDigit(*p)) {
+        ++p;
+    }
+    return p - begin;
+}
+
+#ifdef SLUG_SCAN_X86
+
+// Bytes >= 0x80 are negative as signed chars, so they fall outside every
+// range below without extra masking.
+
+// SSE2 is part of the x86-64 baseline, no feature check needed
+
+__m128i inRange16(__m128i v, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+__m128i alnumMask16(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(inRange16(v, '0', '9'), inRange16(lower, 'a', 'z'));
+}
+
+std::size_t whitespaceSSE2(const char *begin, const char *end,
+                           int &newlines) {
+    const char *p = begin;
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i nl = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+        __m128i ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), nl));
+
+        std::uint32_t miss = ~_mm_movemask_epi8(ws) & 0xFFFFu;
+        std::uint32_t nlBits = _mm_movemask_epi8(nl);
+        if (miss) {
+            int n = __builtin_ctz(miss);
+            newlines += __builtin_popcount(nlBits & ((1u << n) - 1));
+            return p + n - begin;
+        }
+        newlines += __builtin_popcount(nlBits);
+        p += 16;
+    }
+    return p - begin + whitespaceScalar(p, end, newlines);
+}
+
+std::size_t alnumSSE2(const char *begin, const char *end) {
+    const char *p = begin;
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        std::uint32_t miss = ~_mm_movemask_epi8(alnumMask16(v)) & 0xFFFFu;
+        if (miss) {
+            return p + __builtin_ctz(miss) - begin;
+        }
+        p += 16;
+    }
+    return p - begin + alnumScalar(p, end);
+}
+
+std::size_t digitsSSE2(const char *begin, const char *end) {
+    const char *p = begin;
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        std::uint32_t miss =
+            ~_mm_movemask_epi8(inRange16(v, '0', '9')) & 0xFFFFu;
+        if (miss) {
+            return p + __builtin_ctz(miss) - begin;
+        }
+        p += 16;
+    }
+    return p - begin + digitsScalar(p, end);
+}
+
+#define SLUG_AVX2 __attribute__((target("avx2")))
+
+SLUG_AVX2 __m256i inRange32(__m256i v, char lo, char hi) {
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+SLUG_AVX2 std::size_t whitespaceAVX2(const char *begin, const char *end,
+                                     int &newlines) {
+    const char *p = begin;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i nl = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+        __m256i ws = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), nl));
+
+        std::uint32_t miss = ~static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(ws));
+        std::uint32_t nlBits = _mm256_movemask_epi8(nl);
+        if (miss) {
+            int n = __builtin_ctz(miss);
+            newlines +=
+                __builtin_popcount(nlBits & ((std::uint64_t(1) << n) - 1));
+            return p + n - begin;
+        }
+        newlines += __builtin_popcount(nlBits);
+        p += 32;
+    }
+    return p - begin + whitespaceSSE2(p, end, newlines);
+}
+
+SLUG_AVX2 std::size_t alnumAVX2(const char *begin, const char *end) {
+    const char *p = begin;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i hit = _mm256_or_si256(inRange32(v, '0', '9'),
+                                      inRange32(lower, 'a', 'z'));
+        std::uint32_t miss =
+            ~static_cast<std::uint32_t>(_mm256_movemask_epi8(hit));
+        if (miss) {
+            return p + __builtin_ctz(miss) - begin;
+        }
+        p += 32;
+    }
+    return p - begin + alnumSSE2(p, end);
+}
+
+SLUG_AVX2 std::size_t digitsAVX2(const char *begin, const char *end) {
+    const char *p = begin;
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        std::uint32_t miss = ~static_cast<std::uint32_t>(
+            _mm256_movemask_epi8(inRange32(v, '0', '9')));
+        if (miss) {
+            return p + __builtin_ctz(miss) - begin;
+        }
+        p += 32;
+    }
+    return p - begin + digitsSSE2(p, end);
+}
+
+#undef SLUG_AVX2
+
+#endif // SLUG_SCAN_X86
+
+struct Scanners {
+    std::size_t (*whitespace)(const char *, const char *, int &);
+    std::size_t (*alnum)(const char *, const char *);
+    std::size_t (*digits)(const char *, const char *);
+};
+
+Scanners selectScanners() {
+#ifdef SLUG_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return {whitespaceAVX2, alnumAVX2, digitsAVX2};
+    }
+    return {whitespaceSSE2, alnumSSE2, digitsSSE2};
+#else
+    return {whitespaceScalar, alnumScalar, digitsScalar};
+#endif
+}
+
+const Scanners scanners = selectScanners();
+
+} // namespace
+
+std::size_t scanWhitespace(const char *begin, const char *end, int &newlines) {
+    return scanners.whitespace(begin, end, newlines);
+}
+
+std::size_t scanAlnum(const char *begin, const char *end) {
+    return scanners.alnum(begin, end);
+}
+
+std::size_t scanDigits(const char *begin, const char *end) {
+    return scanners.digits(begin, end);
+}
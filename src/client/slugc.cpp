@@ -0,0 +1,44 @@
+#include "daemonClient.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// slugc [--connect=SOCKET] ARGS...: the thin client of `slug --daemon`,
+// which has the daemon listening on SOCKET compile `slug ARGS...`. Whatever
+// the daemon does not compile, and everything when no daemon answers, is
+// handed to slug itself: the one next to slugc, or else the one on the PATH.
+int main(int argc, char **argv) {
+    std::string socket = defaultDaemonSocket();
+    int first = 1;
+    if (argc > 1 && std::strncmp(argv[1], "--connect=", 10) == 0) {
+        socket = argv[1] + 10;
+        first = 2;
+    }
+    std::vector<std::string> args(argv + first, argv + argc);
+
+    if (daemonCompiles(args)) {
+        if (std::optional<int> status = forwardToDaemon(socket, args)) {
+            return *status;
+        }
+    }
+
+    std::string slug = argv[0];
+    std::string::size_type slash = slug.rfind('/');
+    slug = slash == std::string::npos ? "slug"
+                                      : slug.substr(0, slash + 1) + "slug";
+    std::vector<char *> slugArgv{slug.data()};
+    for (int i = first; i < argc; ++i) {
+        slugArgv.push_back(argv[i]);
+    }
+    slugArgv.push_back(nullptr);
+    ::execvp(slug.c_str(), slugArgv.data());
+
+    std::cerr << "Cannot run `" << slug << "`: " << std::strerror(errno)
+              << std::endl;
+    return -1;
+}
@@ -1,8 +1,11 @@
 #include "ast.hpp"
+#include "astContext.hpp"
+#include "bytecode.hpp"
 #include "codegen.hpp"
+#include "compilerOptions.hpp"
+#include "target.hpp"
 #include "type.hpp"
 
-#include <iostream>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constant.h>
 #include <llvm/IR/Constants.h>
@@ -15,75 +18,246 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Verifier.h>
-#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/CodeGen.h>
 #include <llvm/Support/FileSystem.h>
-#include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Target/TargetMachine.h>
-#include <llvm/Target/TargetOptions.h>
-#include <llvm/TargetParser/Host.h>
 
+#include <cstddef>
 #include <memory>
-#include <optional>
 #include <stdexcept>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
+LLVMCodeGen::LLVMCodeGen(const Interner &interner, const ASTContext &ast,
+                         const CompilerOptions &opts)
+    : interner(interner), ast(ast), optLevel(opts.optLevel),
+      target(selectTarget(opts)),
+      context(std::make_unique<llvm::LLVMContext>()),
+      module(std::make_unique<llvm::Module>("main", *context)),
+      builder(*context) {
+    // reject a bad -mcpu before it ends up in any IR
+    if (this->target.cpu != "generic") {
+        this->targetMachine();
+    }
+}
+
+LLVMCodeGen::~LLVMCodeGen() {
+    if (this->machine) {
+        releaseTargetMachine(std::move(this->machine));
+    }
+}
+
+llvm::TargetMachine &LLVMCodeGen::targetMachine() {
+    if (this->machine) {
+        return *this->machine;
+    }
+
+    this->machine = acquireTargetMachine(this->target, this->optLevel);
+    this->module->setTargetTriple(this->machine->getTargetTriple().str());
+
+    // set the data layout (important for pointer sizes, etc.)
+    this->module->setDataLayout(this->machine->createDataLayout());
+
+    return *this->machine;
+}
+
+void LLVMCodeGen::optimize() {
+    llvm::OptimizationLevel level;
+    switch (this->optLevel) {
+    case OptLevel::O0:
+        return;
+    case OptLevel::O1:
+        level = llvm::OptimizationLevel::O1;
+        break;
+    case OptLevel::O2:
+        level = llvm::OptimizationLevel::O2;
+        break;
+    case OptLevel::O3:
+        level = llvm::OptimizationLevel::O3;
+        break;
+    case OptLevel::Os:
+        level = llvm::OptimizationLevel::Os;
+        break;
+    case OptLevel::Oz:
+        level = llvm::OptimizationLevel::Oz;
+        break;
+    }
+
+    // the analyses depend on the target, so the pipeline is built for it
+    llvm::LoopAnalysisManager loopAM;
+    llvm::FunctionAnalysisManager functionAM;
+    llvm::CGSCCAnalysisManager cgsccAM;
+    llvm::ModuleAnalysisManager moduleAM;
+
+    llvm::PassBuilder passBuilder(&this->targetMachine());
+    passBuilder.registerModuleAnalyses(moduleAM);
+    passBuilder.registerCGSCCAnalyses(cgsccAM);
+    passBuilder.registerFunctionAnalyses(functionAM);
+    passBuilder.registerLoopAnalyses(loopAM);
+    passBuilder.crossRegisterProxies(loopAM, functionAM, cgsccAM, moduleAM);
+
+    llvm::ModulePassManager passes =
+        passBuilder.buildPerModuleDefaultPipeline(level);
+    passes.run(*this->module, moduleAM);
+}
+
 void LLVMCodeGen::emitObjectFile(const std::string &filename) {
-    // 1. Initialize all targets for the host machine
-    llvm::InitializeAllTargetInfos();
-    llvm::InitializeAllTargets();
-    llvm::InitializeAllTargetMCs();
-    llvm::InitializeAllAsmParsers();
-    llvm::InitializeAllAsmPrinters();
-
-    // 2. Define the target triple (use host machine's triple)
-    auto targetTriple = llvm::sys::getDefaultTargetTriple();
-    this->module->setTargetTriple(targetTriple);
-
-    // 3. Look up the target
-    std::string error;
-    auto target = llvm::TargetRegistry::lookupTarget(targetTriple, error);
-    if (!target) {
-        throw std::runtime_error(error);
-    }
-
-    // 4. Configure the Target Machine
-    auto CPU = "generic";
-    auto features = "";
-    llvm::TargetOptions opt;
-    std::optional<llvm::Reloc::Model> RM = llvm::Reloc::PIC_;
-    auto targetMachine =
-        target->createTargetMachine(targetTriple, CPU, features, opt, RM);
-
-    // 5. Set Data Layout (important for pointer sizes, etc.)
-    this->module->setDataLayout(targetMachine->createDataLayout());
-
-    // 6. Open the output file
+    // open the output file
     std::error_code ec;
     llvm::raw_fd_ostream dest(filename, ec, llvm::sys::fs::OF_None);
     if (ec) {
         throw std::runtime_error("Could not open file: " + ec.message());
     }
+    this->emitObject(dest);
+    dest.flush();
+}
 
-    // 7. Run the pass manager to emit the object file
+void LLVMCodeGen::emitObject(llvm::raw_pwrite_stream &dest) {
+    llvm::TargetMachine &targetMachine = this->targetMachine();
+
+    // run the pass manager to emit the object file
     llvm::legacy::PassManager pass;
     auto fileType =
         llvm::CodeGenFileType::ObjectFile; // Use .CGFT_ObjectFile in newer LLVM
 
-    if (targetMachine->addPassesToEmitFile(pass, dest, nullptr, fileType)) {
+    if (targetMachine.addPassesToEmitFile(pass, dest, nullptr, fileType)) {
         throw std::runtime_error(
             "TargetMachine can't emit a file of this type");
     }
 
     pass.run(*this->module);
-    dest.flush();
 }
 
-void LLVMCodeGen::visit(LiteralExpr &expr) {
+void LLVMCodeGen::emit(NodeId id) {
+    switch (this->ast.kind(id)) {
+    case NodeKind::Literal:
+    case NodeKind::Variable:
+    case NodeKind::Binary:
+    case NodeKind::Unary:
+    case NodeKind::Call:
+        return this->emitExpr(id);
+    case NodeKind::ExpressionStmt:
+        return this->emitExpressionStmt(id);
+    case NodeKind::Block:
+        return this->emitBlock(id);
+    case NodeKind::Fn:
+        return this->generateFnBody(this->ast.fn(id));
+    case NodeKind::Let:
+        return this->emitLet(id);
+    case NodeKind::Return:
+        return this->emitReturn(id);
+    case NodeKind::Program:
+        throw std::runtime_error("Program node inside a program");
+    }
+}
+
+// Expressions are emitted in post-order over an explicit stack instead of by
+// recursion, so that deeply nested generated code cannot exhaust the native
+// stack. Operands are still emitted left to right.
+void LLVMCodeGen::emitExpr(NodeId root) {
+    std::size_t base = this->pendingExprs.size();
+    this->pendingExprs.push_back({root, false, nullptr});
+
+    while (this->pendingExprs.size() > base) {
+        PendingExpr top = this->pendingExprs.back();
+        NodeKind kind = this->ast.kind(top.id);
+
+        if (!top.expanded && !this->emittedValues.empty()) {
+            if (llvm::Value *value = this->reusableValue(top.id)) {
+                this->pendingExprs.pop_back();
+                this->values.push_back(value);
+                continue;
+            }
+        }
+
+        if (!top.expanded && kind == NodeKind::Binary) {
+            this->pendingExprs.back().expanded = true;
+            this->pendingExprs.push_back({this->ast.rhs(top.id), false});
+            this->pendingExprs.push_back({this->ast.lhs(top.id), false});
+            continue;
+        }
+        if (!top.expanded && kind == NodeKind::Unary) {
+            this->pendingExprs.back().expanded = true;
+            this->pendingExprs.push_back({this->ast.operand(top.id), false});
+            continue;
+        }
+        if (!top.expanded && kind == NodeKind::Call) {
+            this->pendingExprs.back().expanded = true;
+            this->pendingExprs.back().callee =
+                this->findFunction(this->ast.callee(top.id));
+            NodeList<NodeId> args = this->ast.args(top.id);
+            for (std::size_t i = args.size(); i-- > 0;) {
+                this->pendingExprs.push_back({args[i], false});
+            }
+            continue;
+        }
+        this->pendingExprs.pop_back();
+
+        switch (kind) {
+        case NodeKind::Literal:
+            this->emitLiteral(top.id);
+            break;
+        case NodeKind::Variable:
+            this->emitVariable(top.id);
+            break;
+        case NodeKind::Binary: {
+            llvm::Value *rhsValue = this->values.back();
+            this->values.pop_back();
+            llvm::Value *lhsValue = this->values.back();
+            this->values.pop_back();
+            this->emitBinary(top.id, lhsValue, rhsValue);
+            break;
+        }
+        case NodeKind::Unary: {
+            llvm::Value *operandValue = this->values.back();
+            this->values.pop_back();
+            this->emitUnary(top.id, operandValue);
+            break;
+        }
+        case NodeKind::Call: {
+            std::size_t count = this->ast.args(top.id).size();
+            std::size_t first = this->values.size() - count;
+            this->emitCall(top.id, top.callee,
+                           llvm::ArrayRef<llvm::Value *>(
+                               this->values.data() + first, count));
+            this->values.resize(first);
+            break;
+        }
+        default:
+            throw std::runtime_error("Expected an expression");
+        }
+        if (this->ast.hashConsing() && kind != NodeKind::Literal &&
+            kind != NodeKind::Call) {
+            this->emittedValues.insert_or_assign(top.id, this->lastValue);
+        }
+        this->values.push_back(this->lastValue);
+    }
+
+    this->lastValue = this->values.back();
+    this->values.pop_back();
+}
+
+// A function body is a single basic block, so an instruction emitted earlier
+// in the current block dominates the current insertion point.
+llvm::Value *LLVMCodeGen::reusableValue(NodeId id) const {
+    auto found = this->emittedValues.find(id);
+    if (found == this->emittedValues.end()) {
+        return nullptr;
+    }
+    auto *inst = llvm::dyn_cast<llvm::Instruction>(found->second);
+    if (inst && inst->getParent() != this->builder.GetInsertBlock()) {
+        return nullptr;
+    }
+    return found->second;
+}
+
+void LLVMCodeGen::emitLiteral(NodeId id) {
     std::visit(
         [this](auto &&arg) {
             using T = std::decay_t<decltype(arg)>;
@@ -98,44 +272,54 @@ void LLVMCodeGen::visit(LiteralExpr &expr) {
                     llvm::Type::getInt1Ty(*this->context), arg);
             }
         },
-        expr.value.get());
+        this->ast.literal(id).get());
 }
 
-void LLVMCodeGen::visit(VariableExpr &expr) {
-    VariableInfo *info = this->findSymbol(expr.name);
+void LLVMCodeGen::emitVariable(NodeId id) {
+    Symbol name = this->ast.variable(id);
+    VariableInfo *info = this->findSymbol(name);
     if (!info) {
         this->dumpScopes();
-        throw std::runtime_error("Undefined variable: " + expr.name);
+        throw std::runtime_error("Undefined variable: " +
+                                 this->spelling(name).str());
     }
     llvm::Value *val = info->value;
 
     if (!val) {
-        throw std::runtime_error("Error: Variable '" + expr.name +
+        throw std::runtime_error("Error: Variable '" +
+                                 this->spelling(name).str() +
                                  "' has no LLVM value.");
     }
 
-    if (llvm::isa<llvm::AllocaInst>(val)) {
-        llvm::Type *ptrTy = this->toLLVMType(*info->type);
-        this->lastValue =
-            this->builder.CreateLoad(ptrTy, val, (expr.name + ".val").c_str());
+    if (llvm::isa<llvm::GlobalVariable>(val)) {
+        llvm::Type *ptrTy = this->toLLVMType(info->type);
+        this->lastValue = this->builder.CreateLoad(
+            ptrTy, val, this->spelling(name) + ".val");
     } else {
         this->lastValue = val;
     }
 }
 
-void LLVMCodeGen::visit(BinaryExpr &expr) {
-    // generate lhs
-    expr.lhs->accept(*this);
-    llvm::Value *lhsValue = this->lastValue;
-
-    // generate rhs
-    expr.rhs->accept(*this);
-    llvm::Value *rhsValue = this->lastValue;
-
+void LLVMCodeGen::emitBinary(NodeId id, llvm::Value *lhsValue,
+                             llvm::Value *rhsValue) {
     bool isFP = lhsValue->getType()->isFloatingPointTy() ||
                 rhsValue->getType()->isFloatingPointTy();
 
-    switch (expr.op) {
+    // bools only compare, like on the VM
+    BinaryOp op = this->ast.binaryOp(id);
+    bool isArithmetic = op == BinaryOp::Add || op == BinaryOp::Sub ||
+                        op == BinaryOp::Mul || op == BinaryOp::Div ||
+                        op == BinaryOp::Mod;
+    if (isArithmetic && (lhsValue->getType()->isIntegerTy(1) ||
+                         rhsValue->getType()->isIntegerTy(1))) {
+        std::string where =
+            this->curFunc ? " in function '" +
+                                this->spelling(this->curFunc->name).str() + "'"
+                          : "";
+        throw std::runtime_error("Arithmetic on bool" + where);
+    }
+
+    switch (op) {
     case BinaryOp::Add:
         this->lastValue =
             isFP ? this->builder.CreateFAdd(lhsValue, rhsValue, "addtmp")
@@ -160,12 +344,12 @@ void LLVMCodeGen::visit(BinaryExpr &expr) {
         this->lastValue =
             isFP ? this->builder.CreateFRem(lhsValue, rhsValue, "modtmp")
                  : this->builder.CreateSRem(lhsValue, rhsValue, "modtmp");
-
+        break;
     case BinaryOp::Eq:
         this->lastValue =
             isFP ? this->builder.CreateFCmpOEQ(lhsValue, rhsValue, "cmptmp")
-                 : this->lastValue =
-                       this->builder.CreateICmpEQ(lhsValue, rhsValue, "cmptmp");
+                 : this->builder.CreateICmpEQ(lhsValue, rhsValue, "cmptmp");
+        break;
     case BinaryOp::Neq:
         this->lastValue =
             isFP ? this->builder.CreateFCmpONE(lhsValue, rhsValue, "netmp")
@@ -194,83 +378,117 @@ void LLVMCodeGen::visit(BinaryExpr &expr) {
     }
 }
 
-void LLVMCodeGen::visit(UnaryExpr &expr) {
-    (void)expr;
-    throw std::runtime_error("unary expressions not yet implemented");
-}
+void LLVMCodeGen::emitUnary(NodeId id, llvm::Value *operandValue) {
+    llvm::Type *type = operandValue->getType();
 
-void LLVMCodeGen::visit(CallExpr &expr) {
-    llvm::Function *calleeFn = this->module->getFunction(expr.callee);
+    switch (this->ast.unaryOp(id)) {
+    case UnaryOp::Negate:
+        if (type->isFloatingPointTy()) {
+            this->lastValue = this->builder.CreateFNeg(operandValue, "negtmp");
+        } else if (type->isIntegerTy(32)) {
+            this->lastValue = this->builder.CreateNeg(operandValue, "negtmp");
+        } else {
+            throw std::runtime_error("Operator '-' expects a number");
+        }
+        break;
+    case UnaryOp::Not:
+        if (!type->isIntegerTy(1)) {
+            throw std::runtime_error("Operator '!' expects a bool");
+        }
+        this->lastValue = this->builder.CreateNot(operandValue, "nottmp");
+        break;
+    }
+}
 
-    if (!calleeFn) {
-        throw std::runtime_error("Unknown function '" + expr.callee + "'");
+llvm::Function *LLVMCodeGen::findFunction(Symbol name) {
+    auto found = this->functions.find(name);
+    if (found != this->functions.end()) {
+        return found->second;
+    }
+    // a function of another part of the program, see setPartition()
+    if (this->otherFunctions) {
+        auto other = this->otherFunctions->find(name);
+        if (other != this->otherFunctions->end()) {
+            return llvm::cast<llvm::Function>(
+                this->generateFnPrototype(*other->second));
+        }
     }
+    throw std::runtime_error("Unknown function '" + this->spelling(name).str() +
+                             "'");
+}
 
-    std::vector<llvm::Value *> argsV;
-    for (auto &arg : expr.args) {
-        arg->accept(*this);
-        if (!this->lastValue) {
+void LLVMCodeGen::emitCall(NodeId id, llvm::Function *calleeFn,
+                           llvm::ArrayRef<llvm::Value *> args) {
+    for (llvm::Value *arg : args) {
+        if (!arg) {
             throw std::runtime_error(
                 "Failed to generate code for argument in call to function '" +
-                expr.callee + "'");
+                this->spelling(this->ast.callee(id)).str() + "'");
         }
-        argsV.push_back(this->lastValue);
     }
     // if the function has no return value (void) the name is an empty string
-    this->lastValue = this->builder.CreateCall(calleeFn, argsV, "calltmp");
+    this->lastValue = this->builder.CreateCall(calleeFn, args, "calltmp");
 }
 
 ////////
 
-void LLVMCodeGen::visit(ExpressionStmt &stmt) {
-    if (stmt.expr) {
-        stmt.expr->accept(*this);
+void LLVMCodeGen::emitExpressionStmt(NodeId id) {
+    if (this->ast.expr(id) != noNode) {
+        this->emit(this->ast.expr(id));
     }
 
     this->lastValue = nullptr;
 }
 
-void LLVMCodeGen::visit(BlockStmt &stmt) {
-    for (const auto &stmt : stmt.stmts) {
-        stmt->accept(*this);
+void LLVMCodeGen::emitBlock(NodeId id) {
+    for (NodeId stmt : this->ast.stmts(id)) {
+        this->emit(stmt);
     }
 }
 
-void LLVMCodeGen::visit(FnStmt &stmt) { this->generateFnBody(stmt); }
-
-void LLVMCodeGen::visit(LetStmt &stmt) {
-    llvm::Type *llvmTy = this->toLLVMType(stmt.type);
+void LLVMCodeGen::emitLet(NodeId id) {
+    const LetDecl &let = this->ast.let(id);
+    llvm::Type *llvmTy = this->toLLVMType(let.type);
 
     llvm::BasicBlock *currentBlock = this->builder.GetInsertBlock();
     if (!currentBlock) {
         throw std::runtime_error(
             "IRBuilder has no insertion block when allocating variable");
     }
-    llvm::Function *func = currentBlock->getParent();
-    llvm::IRBuilder<> tmpBuilder(&func->getEntryBlock(),
-                                 func->getEntryBlock().begin());
-    llvm::AllocaInst *alloca =
-        tmpBuilder.CreateAlloca(llvmTy, nullptr, stmt.name);
 
-    if (stmt.initializer) {
-        stmt.initializer.get()->accept(*this);
-        llvm::Value *initVal = this->lastValue;
+    llvm::Value *initVal = llvm::Constant::getNullValue(llvmTy);
+    if (let.initializer != noNode) {
+        this->emit(let.initializer);
+        initVal = this->lastValue;
+    }
 
-        this->builder.CreateStore(initVal, alloca);
-    } else {
-        llvm::Value *zeroVal = llvm::Constant::getNullValue(llvmTy);
-        this->builder.CreateStore(zeroVal, alloca);
+    if (initVal->getType() != llvmTy) {
+        std::string actualTyStr, expectedTyStr;
+        llvm::raw_string_ostream actualOS(actualTyStr),
+            expectedOS(expectedTyStr);
+        initVal->getType()->print(actualOS);
+        llvmTy->print(expectedOS);
+
+        throw std::runtime_error(
+            "Type mismatch in function '" +
+            currentBlock->getParent()->getName().str() + "': '" +
+            this->spelling(let.name).str() + "' is declared '" +
+            expectedOS.str() + "' but initialized with '" + actualOS.str() +
+            "'");
     }
 
-    this->declareSymbol(stmt.name, stmt.mut, &stmt.type, alloca);
+    // slug has no assignment, so even a mutable binding is just its value
+    // and reading it needs no load
+    this->declareSymbol(let.name, let.mut, &let.type, initVal);
 }
 
-void LLVMCodeGen::visit(ReturnStmt &stmt) {
+void LLVMCodeGen::emitReturn(NodeId id) {
+    NodeId value = this->ast.returnValue(id);
     llvm::Function *curFunc = this->builder.GetInsertBlock()->getParent();
     llvm::Type *expectedRetTy = curFunc->getReturnType();
     std::string funcName = curFunc->getName().str();
 
-    if (stmt.value.has_value()) {
+    if (value != noNode) {
         // check return type in source code so e.g. `return 5;` is not possible
         // in `main()`
         if (this->curFunc->retType.kind == PrimitiveType::Void) {
@@ -279,7 +497,7 @@ void LLVMCodeGen::visit(ReturnStmt &stmt) {
                 "': " + "cannot return a value from a void function.");
         }
 
-        stmt.value->get()->accept(*this);
+        this->emit(value);
         llvm::Value *retVal = this->lastValue;
 
         if (retVal->getType() != expectedRetTy) {
@@ -311,24 +529,27 @@ void LLVMCodeGen::visit(ReturnStmt &stmt) {
     }
 }
 
-void LLVMCodeGen::visit(Program &stmt) {
+void LLVMCodeGen::generate(NodeId program) {
     this->scopeStack.clear();
     this->pushScope(); // global scope (index 0)
 
-    this->declareGlobals(stmt);
+    this->declareGlobals(program);
 
     bool hasMain = false;
 
-    for (const auto &stmt : stmt.stmts) {
-        if (auto *fn = dynamic_cast<FnStmt *>(stmt.get())) {
-            if (fn->name == "main") {
+    NodeList<NodeId> stmts = this->ast.stmts(program);
+    for (std::size_t i = 0; i < stmts.size(); ++i) {
+        if (this->ast.kind(stmts[i]) == NodeKind::Fn) {
+            const FnDecl &fn = this->ast.fn(stmts[i]);
+            if (this->isMain(fn)) {
                 hasMain = true;
             }
 
-            fn->accept(*this);
-        } else {
-            throw std::runtime_error("Top level code not yet implemented");
+            if (this->inPartition(i)) {
+                this->generateFnBody(fn);
+            }
         }
+        // top-level lets were emitted as globals by declareGlobals
     }
 
     if (!hasMain) {
@@ -340,24 +561,74 @@ void LLVMCodeGen::visit(Program &stmt) {
     llvm::raw_string_ostream errStream(errStr);
 
     if (llvm::verifyModule(*this->module, &errStream)) {
-        this->dumpIR();
+        this->dumpIR(*this->irDump);
         throw std::runtime_error("IR verification failed:\n" + errStream.str());
     }
 }
 
+void LLVMCodeGen::generateSlotEntries() {
+    llvm::Type *slotPtrTy = llvm::PointerType::getUnqual(*this->context);
+    llvm::FunctionType *entryTy = llvm::FunctionType::get(
+        this->builder.getVoidTy(), {slotPtrTy}, /*isVarArg=*/false);
+    // a bool is a whole i32 in a slot
+    llvm::Type *boolSlotTy = this->builder.getInt32Ty();
+
+    std::vector<llvm::Function *> targets;
+    for (llvm::Function &fn : *this->module) {
+        targets.push_back(&fn);
+    }
+
+    for (llvm::Function *fn : targets) {
+        llvm::Function *entry = llvm::Function::Create(
+            entryTy, llvm::Function::ExternalLinkage,
+            fn->getName() + slotEntrySuffix, *this->module);
+        this->builder.SetInsertPoint(
+            llvm::BasicBlock::Create(*this->context, "entry", entry));
+        llvm::Value *window = entry->getArg(0);
+
+        std::vector<llvm::Value *> args;
+        for (llvm::Argument &param : fn->args()) {
+            llvm::Value *slot = this->builder.CreateConstInBoundsGEP1_64(
+                this->builder.getInt8Ty(), window,
+                param.getArgNo() * sizeof(Slot));
+            if (param.getType()->isIntegerTy(1)) {
+                args.push_back(this->builder.CreateICmpNE(
+                    this->builder.CreateLoad(boolSlotTy, slot),
+                    this->builder.getInt32(0)));
+            } else {
+                args.push_back(
+                    this->builder.CreateLoad(param.getType(), slot));
+            }
+        }
+
+        llvm::Value *result = this->builder.CreateCall(fn, args);
+        if (result->getType()->isIntegerTy(1)) {
+            result = this->builder.CreateZExt(result, boolSlotTy);
+        }
+        if (!result->getType()->isVoidTy()) {
+            this->builder.CreateStore(result, window);
+        }
+        this->builder.CreateRetVoid();
+    }
+}
+
 //////
 
-void LLVMCodeGen::declareSymbol(const std::string &name, bool mut,
-                                const Type *type, llvm::Value *value) {
+void LLVMCodeGen::declareSymbol(Symbol name, bool mut, const Type *type,
+                                llvm::Value *value) {
     if (this->scopeStack.empty()) {
         this->pushScope();
     }
+    // shadowing changes what already emitted expressions would refer to
+    if (!this->emittedValues.empty() && this->findSymbol(name)) {
+        this->emittedValues.clear();
+    }
 
     scopeStack.back().insert_or_assign(
-        name, VariableInfo(value, mut, std::make_shared<Type>(*type)));
+        name, VariableInfo(value, mut, *type));
 }
 
-VariableInfo *LLVMCodeGen::findSymbol(const std::string &name) {
+VariableInfo *LLVMCodeGen::findSymbol(Symbol name) {
     // going from back to front
     for (auto it = scopeStack.rbegin(); it != scopeStack.rend(); ++it) {
         auto found = it->find(name);
@@ -369,24 +640,51 @@ VariableInfo *LLVMCodeGen::findSymbol(const std::string &name) {
 }
 
 void LLVMCodeGen::dumpScopes() const {
-    std::cerr << "\n=== SCOPE STACK DUMP ===\n";
+    llvm::raw_ostream &os = *this->scopeDump;
+    os << "\n=== SCOPE STACK DUMP ===\n";
     for (int i = scopeStack.size() - 1; i >= 0; --i) {
-        std::cerr << "Level " << i << (i == 0 ? " (Global): " : " (Local): ");
+        os << "Level " << i << (i == 0 ? " (Global): " : " (Local): ");
         for (const auto &[name, info] : scopeStack[i]) {
-            std::cerr << name << " ";
+            os << this->spelling(name) << " ";
+        }
+        os << "\n";
+    }
+    os << "========================\n\n";
+}
+
+LLVMCodeGen::FunctionIndex LLVMCodeGen::indexFunctions(const ASTContext &ast,
+                                                      NodeId program) {
+    FunctionIndex functions;
+    for (NodeId stmt : ast.stmts(program)) {
+        if (ast.kind(stmt) == NodeKind::Fn) {
+            functions.emplace(ast.fn(stmt).name, &ast.fn(stmt));
         }
-        std::cerr << "\n";
     }
-    std::cerr << "========================\n\n";
+    return functions;
 }
 
-void LLVMCodeGen::declareGlobals(const Program &program) {
-    for (const auto &stmt : program.stmts) {
-        if (auto *fn = dynamic_cast<FnStmt *>(stmt.get())) {
-            this->declareSymbol(fn->name, /*mut=*/false, /*type=*/&fn->retType,
-                                this->generateFnPrototype(*fn));
-        } else if (auto *let = dynamic_cast<LetStmt *>(stmt.get())) {
-            this->declareGlobalVariable(*let);
+void LLVMCodeGen::setPartition(std::size_t first, std::size_t last,
+                               bool defineGlobals,
+                               const FunctionIndex &functions) {
+    this->partitionFirst = first;
+    this->partitionLast = last;
+    this->definesGlobals = defineGlobals;
+    this->otherFunctions = &functions;
+}
+
+void LLVMCodeGen::declareGlobals(NodeId program) {
+    NodeList<NodeId> stmts = this->ast.stmts(program);
+    for (std::size_t i = 0; i < stmts.size(); ++i) {
+        NodeId stmt = stmts[i];
+        if (this->ast.kind(stmt) == NodeKind::Fn) {
+            const FnDecl &fn = this->ast.fn(stmt);
+            if (!this->inPartition(i)) {
+                continue; // only declared if called, see findFunction()
+            }
+            this->declareSymbol(fn.name, /*mut=*/false, /*type=*/&fn.retType,
+                                this->generateFnPrototype(fn));
+        } else if (this->ast.kind(stmt) == NodeKind::Let) {
+            this->declareGlobalVariable(this->ast.let(stmt));
         } else {
             throw std::runtime_error("Only functions and variable declarations "
                                      "can be declared at top level");
@@ -394,13 +692,14 @@ void LLVMCodeGen::declareGlobals(const Program &program) {
     }
 }
 
-llvm::Value *LLVMCodeGen::generateFnPrototype(const FnStmt &fn) {
+llvm::Value *LLVMCodeGen::generateFnPrototype(const FnDecl &fn) {
+    NodeList<FnParam> params = this->ast.params(fn);
     std::vector<llvm::Type *> paramTypes;
-    for (const auto &param : fn.params) {
+    for (const auto &param : params) {
         paramTypes.push_back(this->toLLVMType(param.type));
     }
 
-    llvm::Type *retType = fn.name == "main"
+    llvm::Type *retType = this->isMain(fn)
                               ? llvm::Type::getInt32Ty(*this->context)
                               : this->toLLVMType(fn.retType);
 
@@ -408,24 +707,34 @@ llvm::Value *LLVMCodeGen::generateFnPrototype(const FnStmt &fn) {
         llvm::FunctionType::get(retType, paramTypes, /*isVarArg=*/false);
 
     llvm::Function *function = llvm::Function::Create(
-        fnType, llvm::Function::ExternalLinkage, fn.name, *this->module);
+        fnType, llvm::Function::ExternalLinkage, this->spelling(fn.name),
+        *this->module);
+    this->functions[fn.name] = function;
+
+    // per-function copies of the target, which is what the IR-level cost
+    // models (e.g. the vectorizers) consult
+    if (this->target.cpu != "generic") {
+        function->addFnAttr("target-cpu", this->target.cpu);
+    }
+    if (!this->target.features.empty()) {
+        function->addFnAttr("target-features", this->target.features);
+    }
 
     unsigned idx = 0;
     for (auto &arg : function->args()) {
-        arg.setName(fn.params[idx++].name);
+        arg.setName(this->spelling(params[idx++].name));
     }
 
     return function;
 }
 
-void LLVMCodeGen::generateFnBody(FnStmt &fn) {
-    llvm::Function *F = module->getFunction(fn.name);
-    if (!F) {
-        throw std::runtime_error(""); // impossible
-    }
+void LLVMCodeGen::generateFnBody(const FnDecl &fn) {
+    NodeList<FnParam> params = this->ast.params(fn);
+    llvm::Function *F = this->functions.at(fn.name);
 
     // set current function
     this->curFunc = &fn;
+    this->emittedValues.clear();
 
     // new local scope
     this->pushScope();
@@ -435,19 +744,19 @@ void LLVMCodeGen::generateFnBody(FnStmt &fn) {
 
     int argIdx = 0;
     for (auto &arg : F->args()) {
-        std::string argName = fn.params[argIdx].name;
-        arg.setName(argName);
+        Symbol argName = params[argIdx].name;
+        arg.setName(this->spelling(argName));
 
-        this->declareSymbol(argName, /*mut=*/false, &fn.params[argIdx].type,
+        this->declareSymbol(argName, /*mut=*/false, &params[argIdx].type,
                             /*value=*/&arg);
         ++argIdx;
     }
 
     // generate body code
-    fn.body->accept(*this);
+    this->emit(fn.body);
 
     // return void functions if no return
-    if (fn.name == "main") {
+    if (this->isMain(fn) && !BB->getTerminator()) {
         this->builder.CreateRet(
             llvm::ConstantInt::get(llvm::Type::getInt32Ty(*this->context), 0));
     } else if (fn.retType.kind == PrimitiveType::Void && !BB->getTerminator()) {
@@ -459,11 +768,12 @@ void LLVMCodeGen::generateFnBody(FnStmt &fn) {
     this->curFunc = nullptr;
 }
 
-void LLVMCodeGen::declareGlobalVariable(const LetStmt &let) {
-    llvm::Constant *initConstant = nullptr;
+void LLVMCodeGen::declareGlobalVariable(const LetDecl &let) {
+    llvm::Type *llvmTy = this->toLLVMType(let.type);
+    llvm::Constant *initConstant = llvm::Constant::getNullValue(llvmTy);
 
-    if (let.initializer) {
-        let.initializer.get()->accept(*this);
+    if (let.initializer != noNode) {
+        this->emit(let.initializer);
         llvm::Value *initVal = this->lastValue;
 
         if (llvm::isa<llvm::ConstantExpr>(initVal) ||
@@ -473,16 +783,38 @@ void LLVMCodeGen::declareGlobalVariable(const LetStmt &let) {
             throw std::runtime_error(
                 "Global variable initializer must be constant");
         }
-    } else {
-        llvm::Type *llvmTy = this->toLLVMType(let.type);
-        initConstant = llvm::Constant::getNullValue(llvmTy);
     }
 
-    llvm::Type *llvmTy = initConstant->getType();
+    // emitVariable() loads globals as their declared type
+    if (initConstant->getType() != llvmTy) {
+        std::string actualTyStr, expectedTyStr;
+        llvm::raw_string_ostream actualOS(actualTyStr),
+            expectedOS(expectedTyStr);
+        initConstant->getType()->print(actualOS);
+        llvmTy->print(expectedOS);
+
+        throw std::runtime_error("Type mismatch: global '" +
+                                 this->spelling(let.name).str() +
+                                 "' is declared '" + expectedOS.str() +
+                                 "' but initialized with '" + actualOS.str() +
+                                 "'");
+    }
+
+    // Another part of the program defines it. An immutable one keeps its
+    // initializer, available_externally, so loads of it still fold.
+    llvm::GlobalValue::LinkageTypes linkage =
+        llvm::GlobalValue::ExternalLinkage;
+    if (!this->definesGlobals) {
+        if (let.mut) {
+            initConstant = nullptr;
+        } else {
+            linkage = llvm::GlobalValue::AvailableExternallyLinkage;
+        }
+    }
 
     llvm::GlobalVariable *globalVar = new llvm::GlobalVariable(
-        *this->module, llvmTy, /*isConstant=*/!let.mut,
-        llvm::GlobalValue::ExternalLinkage, initConstant, let.name);
+        *this->module, llvmTy, /*isConstant=*/!let.mut, linkage, initConstant,
+        this->spelling(let.name));
 
     this->declareSymbol(let.name, let.mut, &let.type, globalVar);
 }
@@ -0,0 +1,232 @@
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "constEvaluator.hpp"
+#include "literal.hpp"
+#include "literalOps.hpp"
+#include "type.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void ConstEvaluator::bindGlobal(Symbol name, std::optional<Literal> value) {
+    this->globals.insert_or_assign(name, value);
+}
+
+Literal ConstEvaluator::call(Symbol owner, Symbol callee, const Literal *args,
+                             std::size_t count) {
+    this->owner = owner;
+    this->steps = 0;
+    this->depth = 0;
+    this->locals.clear();
+    this->frame = 0;
+    this->pendingExprs.clear();
+    this->values.clear();
+
+    return this->callFn(callee, args, count);
+}
+
+Literal ConstEvaluator::callFn(Symbol callee, const Literal *args,
+                               std::size_t count) {
+    auto found = this->functions.find(callee);
+    if (found == this->functions.end()) {
+        this->fail("unknown function '" +
+                   std::string(this->interner.spelling(callee)) + "'");
+    }
+    const FnDecl &fn = *found->second;
+    std::string name(this->interner.spelling(fn.name));
+
+    if (++this->depth > maxDepth) {
+        this->fail("calls nested deeper than " + std::to_string(maxDepth));
+    }
+
+    NodeList<FnParam> params = this->ast.params(fn);
+    if (params.size() != count) {
+        this->fail("wrong number of arguments to '" + name + "'");
+    }
+
+    std::size_t outerFrame = this->frame;
+    this->frame = this->locals.size();
+    for (std::size_t i = 0; i < count; ++i) {
+        if (!hasType(args[i], params[i].type)) {
+            this->fail("argument of the wrong type to '" + name + "'");
+        }
+        this->locals.emplace_back(params[i].name, args[i]);
+    }
+
+    std::optional<Literal> result;
+    this->execute(fn.body, result);
+    if (!result) {
+        this->fail("'" + name + "' does not return a value");
+    }
+    if (!hasType(*result, fn.retType)) {
+        this->fail("'" + name + "' returns a value of the wrong type");
+    }
+
+    this->locals.resize(this->frame);
+    this->frame = outerFrame;
+    --this->depth;
+    return *result;
+}
+
+// Returns true once a return statement has been executed.
+bool ConstEvaluator::execute(NodeId stmt, std::optional<Literal> &result) {
+    this->step();
+
+    switch (this->ast.kind(stmt)) {
+    case NodeKind::ExpressionStmt:
+        if (this->ast.expr(stmt) != noNode) {
+            this->evaluate(this->ast.expr(stmt));
+        }
+        return false;
+    case NodeKind::Block:
+        for (NodeId child : this->ast.stmts(stmt)) {
+            if (this->execute(child, result)) {
+                return true;
+            }
+        }
+        return false;
+    case NodeKind::Let: {
+        const LetDecl &let = this->ast.let(stmt);
+        Literal value;
+        if (let.initializer != noNode) {
+            value = this->evaluate(let.initializer);
+        } else if (let.type.kind == PrimitiveType::I32) {
+            value = Literal(0);
+        } else if (let.type.kind == PrimitiveType::F64) {
+            value = Literal(0.0);
+        } else {
+            value = Literal(false);
+        }
+        if (!hasType(value, let.type)) {
+            this->fail("'" + std::string(this->interner.spelling(let.name)) +
+                       "' initialized with a value of the wrong type");
+        }
+        this->locals.emplace_back(let.name, value);
+        return false;
+    }
+    case NodeKind::Return:
+        if (this->ast.returnValue(stmt) != noNode) {
+            result = this->evaluate(this->ast.returnValue(stmt));
+        }
+        return true;
+    case NodeKind::Fn:
+        return false;
+    default:
+        this->fail("unexpected statement");
+    }
+}
+
+// Post-order over an explicit stack like the other expression walks; only
+// slug calls recurse, and those are bounded by maxDepth.
+Literal ConstEvaluator::evaluate(NodeId root) {
+    std::size_t base = this->pendingExprs.size();
+    this->pendingExprs.push_back({root, false});
+
+    while (this->pendingExprs.size() > base) {
+        PendingExpr top = this->pendingExprs.back();
+        NodeKind kind = this->ast.kind(top.id);
+
+        if (!top.expanded) {
+            this->step();
+            if (kind == NodeKind::Binary) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.push_back({this->ast.rhs(top.id), false});
+                this->pendingExprs.push_back({this->ast.lhs(top.id), false});
+                continue;
+            }
+            if (kind == NodeKind::Unary) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.push_back(
+                    {this->ast.operand(top.id), false});
+                continue;
+            }
+            if (kind == NodeKind::Call) {
+                this->pendingExprs.back().expanded = true;
+                NodeList<NodeId> args = this->ast.args(top.id);
+                for (std::size_t i = args.size(); i-- > 0;) {
+                    this->pendingExprs.push_back({args[i], false});
+                }
+                continue;
+            }
+        }
+        this->pendingExprs.pop_back();
+
+        switch (kind) {
+        case NodeKind::Literal:
+            this->values.push_back(this->ast.literal(top.id));
+            break;
+        case NodeKind::Variable:
+            this->values.push_back(this->lookup(this->ast.variable(top.id)));
+            break;
+        case NodeKind::Binary:
+        case NodeKind::Unary: {
+            LiteralResult result;
+            if (kind == NodeKind::Binary) {
+                Literal rhs = this->values.back();
+                this->values.pop_back();
+                result = applyBinary(this->ast.binaryOp(top.id),
+                                     this->values.back(), rhs);
+            } else {
+                result = applyUnary(this->ast.unaryOp(top.id),
+                                    this->values.back());
+            }
+            if (result.error) {
+                this->fail(result.error);
+            }
+            if (!result.value) {
+                this->fail("operator applied to operands of the wrong type");
+            }
+            this->values.back() = *result.value;
+            break;
+        }
+        case NodeKind::Call: {
+            std::size_t count = this->ast.args(top.id).size();
+            std::size_t first = this->values.size() - count;
+            // the callee pushes onto `values`, so pass a copy
+            std::vector<Literal> args(this->values.begin() + first,
+                                      this->values.end());
+            this->values.resize(first);
+            this->values.push_back(this->callFn(this->ast.callee(top.id),
+                                                args.data(), count));
+            break;
+        }
+        default:
+            this->fail("unexpected expression");
+        }
+    }
+
+    Literal value = this->values.back();
+    this->values.pop_back();
+    return value;
+}
+
+Literal ConstEvaluator::lookup(Symbol name) const {
+    for (std::size_t i = this->locals.size(); i-- > this->frame;) {
+        if (this->locals[i].first == name) {
+            return this->locals[i].second;
+        }
+    }
+
+    auto found = this->globals.find(name);
+    if (found == this->globals.end() || !found->second) {
+        this->fail("'" + std::string(this->interner.spelling(name)) +
+                   "' is not a constant");
+    }
+    return *found->second;
+}
+
+void ConstEvaluator::step() {
+    if (++this->steps > maxSteps) {
+        this->fail("evaluation took more than " + std::to_string(maxSteps) +
+                   " steps");
+    }
+}
+
+void ConstEvaluator::fail(const std::string &why) const {
+    throw std::runtime_error("Cannot evaluate the initializer of '" +
+                             std::string(this->interner.spelling(this->owner)) +
+                             "' at compile time: " + why);
+}
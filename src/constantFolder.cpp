@@ -0,0 +1,269 @@
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "constantFolder.hpp"
+#include "literal.hpp"
+#include "literalOps.hpp"
+#include "type.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void ConstantFolder::fold(NodeId program) {
+    this->scopes.clear();
+    this->scopes.push_back({});
+
+    NodeList<NodeId> stmts = this->ast.stmts(program);
+    for (NodeId stmt : stmts) {
+        if (this->ast.kind(stmt) == NodeKind::Fn) {
+            this->evaluator.addFunction(this->ast.fn(stmt));
+        }
+    }
+
+    // codegen declares every global, in order, before any function body
+    for (std::size_t i = 0; i < stmts.size(); ++i) {
+        NodeId stmt = this->ast.stmts(program)[i];
+        if (this->ast.kind(stmt) == NodeKind::Let) {
+            this->owner = this->ast.let(stmt).name;
+            this->foldStmt(stmt);
+            this->ast.closeSharingScope();
+        }
+    }
+    for (std::size_t i = 0; i < stmts.size(); ++i) {
+        NodeId stmt = this->ast.stmts(program)[i];
+        if (this->ast.kind(stmt) == NodeKind::Fn) {
+            this->foldFn(this->ast.fn(stmt));
+            this->ast.closeSharingScope();
+        }
+    }
+}
+
+void ConstantFolder::foldStmt(NodeId id) {
+    switch (this->ast.kind(id)) {
+    case NodeKind::ExpressionStmt:
+        if (this->ast.expr(id) != noNode) {
+            this->ast.setExpr(id, this->foldExpr(this->ast.expr(id)));
+        }
+        break;
+    case NodeKind::Block:
+        // folding adds nodes and lists, so re-fetch the list every time
+        for (std::size_t i = 0; i < this->ast.stmts(id).size(); ++i) {
+            this->foldStmt(this->ast.stmts(id)[i]);
+        }
+        break;
+    case NodeKind::Fn:
+        this->foldFn(this->ast.fn(id));
+        break;
+    case NodeKind::Let: {
+        const LetDecl &let = this->ast.let(id);
+        NodeId value = noNode;
+        if (let.initializer != noNode) {
+            NodeId init = this->foldExpr(let.initializer);
+            this->ast.setInitializer(id, init);
+            if (!let.mut && this->ast.kind(init) == NodeKind::Literal &&
+                hasType(this->ast.literal(init), let.type)) {
+                value = init;
+            }
+        }
+        this->bind(let.name, value);
+        if (this->scopes.size() == 1) {
+            this->evaluator.bindGlobal(
+                let.name, value != noNode
+                              ? std::optional(this->ast.literal(value))
+                              : std::nullopt);
+        }
+        break;
+    }
+    case NodeKind::Return:
+        if (this->ast.returnValue(id) != noNode) {
+            this->ast.setReturnValue(
+                id, this->foldExpr(this->ast.returnValue(id)));
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void ConstantFolder::foldFn(const FnDecl &fn) {
+    Symbol outer = this->owner;
+    this->owner = fn.name;
+
+    this->scopes.push_back({});
+    for (const FnParam &param : this->ast.params(fn)) {
+        this->bind(param.name, noNode);
+    }
+    this->foldStmt(fn.body);
+    this->scopes.pop_back();
+
+    this->owner = outer;
+}
+
+// Post-order over an explicit stack, like codegen, so deeply nested
+// expressions cannot exhaust the native stack. Every visited node leaves
+// its replacement, which is the node itself when nothing below it changed.
+NodeId ConstantFolder::foldExpr(NodeId root) {
+    std::size_t base = this->pendingExprs.size();
+    this->pendingExprs.push_back({root, false});
+
+    while (this->pendingExprs.size() > base) {
+        PendingExpr top = this->pendingExprs.back();
+        NodeKind kind = this->ast.kind(top.id);
+
+        if (!top.expanded) {
+            if (kind == NodeKind::Binary) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.push_back({this->ast.rhs(top.id), false});
+                this->pendingExprs.push_back({this->ast.lhs(top.id), false});
+                continue;
+            }
+            if (kind == NodeKind::Unary) {
+                this->pendingExprs.back().expanded = true;
+                this->pendingExprs.push_back(
+                    {this->ast.operand(top.id), false});
+                continue;
+            }
+            if (kind == NodeKind::Call) {
+                this->pendingExprs.back().expanded = true;
+                NodeList<NodeId> args = this->ast.args(top.id);
+                for (std::size_t i = args.size(); i-- > 0;) {
+                    this->pendingExprs.push_back({args[i], false});
+                }
+                continue;
+            }
+        }
+        this->pendingExprs.pop_back();
+
+        NodeId folded = top.id;
+        switch (kind) {
+        case NodeKind::Literal:
+            break;
+        case NodeKind::Variable:
+            folded = this->foldVariable(top.id);
+            break;
+        case NodeKind::Binary: {
+            NodeId rhs = this->results.back();
+            this->results.pop_back();
+            NodeId lhs = this->results.back();
+            this->results.pop_back();
+            folded = this->foldBinary(top.id, lhs, rhs);
+            break;
+        }
+        case NodeKind::Unary: {
+            NodeId operand = this->results.back();
+            this->results.pop_back();
+            folded = this->foldUnary(top.id, operand);
+            break;
+        }
+        case NodeKind::Call: {
+            std::size_t count = this->ast.args(top.id).size();
+            std::size_t first = this->results.size() - count;
+            folded = this->foldCall(top.id, this->results.data() + first);
+            this->results.resize(first);
+            break;
+        }
+        default:
+            throw std::runtime_error("Expected an expression");
+        }
+        this->results.push_back(folded);
+    }
+
+    NodeId folded = this->results.back();
+    this->results.pop_back();
+    return folded;
+}
+
+NodeId ConstantFolder::foldVariable(NodeId id) {
+    NodeId value = this->lookup(this->ast.variable(id));
+    return value != noNode ? value : id;
+}
+
+NodeId ConstantFolder::foldBinary(NodeId id, NodeId lhs, NodeId rhs) {
+    BinaryOp op = this->ast.binaryOp(id);
+
+    if (this->ast.kind(lhs) == NodeKind::Literal &&
+        this->ast.kind(rhs) == NodeKind::Literal) {
+        LiteralResult result = applyBinary(op, this->ast.literal(lhs),
+                                           this->ast.literal(rhs));
+        if (result.error) {
+            this->error(result.error);
+        }
+        if (result.value) {
+            return this->ast.addLiteral(*result.value);
+        }
+    }
+
+    if (lhs == this->ast.lhs(id) && rhs == this->ast.rhs(id)) {
+        return id;
+    }
+    return this->ast.addBinary(op, lhs, rhs);
+}
+
+NodeId ConstantFolder::foldUnary(NodeId id, NodeId operand) {
+    UnaryOp op = this->ast.unaryOp(id);
+
+    if (this->ast.kind(operand) == NodeKind::Literal) {
+        LiteralResult result = applyUnary(op, this->ast.literal(operand));
+        if (result.error) {
+            this->error(result.error);
+        }
+        if (result.value) {
+            return this->ast.addLiteral(*result.value);
+        }
+    }
+
+    if (operand == this->ast.operand(id)) {
+        return id;
+    }
+    return this->ast.addUnary(op, operand);
+}
+
+NodeId ConstantFolder::foldCall(NodeId id, const NodeId *args) {
+    NodeList<NodeId> original = this->ast.args(id);
+
+    // a global initializer must be constant, so calls in one are evaluated
+    if (this->scopes.size() == 1) {
+        this->callArgs.clear();
+        for (std::size_t i = 0; i < original.size(); ++i) {
+            if (this->ast.kind(args[i]) != NodeKind::Literal) {
+                break;
+            }
+            this->callArgs.push_back(this->ast.literal(args[i]));
+        }
+        if (this->callArgs.size() == original.size()) {
+            return this->ast.addLiteral(this->evaluator.call(
+                this->owner, this->ast.callee(id), this->callArgs.data(),
+                this->callArgs.size()));
+        }
+    }
+
+    for (std::size_t i = 0; i < original.size(); ++i) {
+        if (args[i] != original[i]) {
+            return this->ast.addCall(this->ast.callee(id), args,
+                                     original.size());
+        }
+    }
+    return id;
+}
+
+void ConstantFolder::bind(Symbol name, NodeId value) {
+    this->scopes.back().insert_or_assign(name, value);
+}
+
+NodeId ConstantFolder::lookup(Symbol name) const {
+    for (auto it = this->scopes.rbegin(); it != this->scopes.rend(); ++it) {
+        auto found = it->find(name);
+        if (found != it->end()) {
+            return found->second;
+        }
+    }
+    return noNode;
+}
+
+void ConstantFolder::error(const std::string &what) const {
+    throw std::runtime_error(what + " in constant expression in '" +
+                             std::string(this->interner.spelling(this->owner)) +
+                             "'");
+}
@@ -0,0 +1,146 @@
+#include "compilerOptions.hpp"
+#include "daemon.hpp"
+#include "daemonClient.hpp"
+#include "driver.hpp"
+#include "parallel.hpp"
+#include "target.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// nothing a client sends is ever this long; guards against garbage
+constexpr std::uint32_t maxRequest = 1u << 20;
+
+// closes a client's connection however its request ends
+class Connection {
+  public:
+    explicit Connection(int fd) : fd(fd) {}
+    ~Connection() { ::close(this->fd); }
+
+    Connection(const Connection &) = delete;
+    Connection &operator=(const Connection &) = delete;
+
+  private:
+    int fd;
+};
+
+} // namespace
+
+Daemon::Daemon(std::string socket, unsigned workers)
+    : socket(std::move(socket)), workers(workers) {
+    // a socket file without a daemon is left over from one that was killed
+    int running = connectTo(this->socket);
+    if (running >= 0) {
+        ::close(running);
+        throw std::runtime_error("A daemon already listens on `" +
+                                 this->socket + "`");
+    }
+    ::unlink(this->socket.c_str());
+
+    this->listener = listenOn(this->socket);
+    if (this->listener < 0) {
+        throw std::runtime_error("Cannot listen on `" + this->socket +
+                                 "`: " + std::strerror(errno));
+    }
+}
+
+Daemon::~Daemon() {
+    ::close(this->listener);
+    ::unlink(this->socket.c_str());
+}
+
+void Daemon::serve() {
+    // a client that goes away must not take the daemon with it
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // initialize the targets now rather than on the first request
+    CompilerOptions defaults;
+    releaseTargetMachine(
+        acquireTargetMachine(selectTarget(defaults), defaults.optLevel));
+
+    std::cerr << "slug daemon listening on " << this->socket << std::endl;
+
+    // every worker accepts and serves clients of its own
+    parallelFor(this->workers, this->workers, [this](std::size_t) {
+        for (;;) {
+            int client = ::accept4(this->listener, nullptr, nullptr,
+                                   SOCK_CLOEXEC);
+            if (client >= 0) {
+                this->serveClient(client);
+            } else if (errno != EINTR && errno != ECONNABORTED) {
+                return;
+            }
+        }
+    });
+}
+
+void Daemon::serveClient(int client) {
+    Connection connection(client);
+    try {
+        std::uint32_t count = readU32(client);
+        if (count > maxRequest) {
+            throw std::runtime_error("Malformed request");
+        }
+        std::string workDir = readString(client, maxRequest);
+        std::vector<std::string> args{"slug"};
+        for (std::uint32_t i = 0; i < count; ++i) {
+            args.push_back(readString(client, maxRequest));
+        }
+
+        std::ostringstream out;
+        std::ostringstream err;
+        int status = 0;
+        try {
+            if (!daemonCompiles({args.begin() + 1, args.end()})) {
+                throw std::runtime_error(
+                    "The daemon only compiles source files");
+            }
+            std::vector<char *> argv;
+            for (std::string &arg : args) {
+                argv.push_back(arg.data());
+            }
+            argv.push_back(nullptr);
+
+            Driver driver;
+            CompilerOptions opts =
+                driver.parseArgs(static_cast<int>(args.size()), argv.data());
+
+            // the daemon's working directory is not the client's; sources
+            // stay as given, for messages to name them like slug would
+            auto resolve = [&workDir](std::string &path) {
+                if (!path.empty()) {
+                    path = (std::filesystem::path(workDir) / path).string();
+                }
+            };
+            resolve(opts.outfile);
+            resolve(opts.cacheDir);
+            opts.workDir = workDir;
+
+            status = driver.compile(opts, out, err);
+        } catch (const std::exception &e) {
+            err << e.what() << std::endl;
+            status = -1;
+        }
+
+        writeU32(client, static_cast<std::uint32_t>(status));
+        writeString(client, out.str());
+        writeString(client, err.str());
+    } catch (const std::exception &) {
+        // the client went away, or was not one
+    }
+}
@@ -0,0 +1,193 @@
+#include "daemonClient.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+void writeAll(int fd, const char *data, std::size_t size) {
+    while (size > 0) {
+        // a peer that went away is an error here, not a SIGPIPE
+        ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            throw std::runtime_error(std::string("Cannot write to socket: ") +
+                                     std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+void readAll(int fd, char *data, std::size_t size) {
+    while (size > 0) {
+        ssize_t got = ::recv(fd, data, size, 0);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            throw std::runtime_error("Connection closed early");
+        }
+        data += got;
+        size -= static_cast<std::size_t>(got);
+    }
+}
+
+// false if the path does not fit, with errno set like the kernel would
+bool socketAddress(const std::string &socket, sockaddr_un &address) {
+    address = {};
+    address.sun_family = AF_UNIX;
+    if (socket.size() >= sizeof address.sun_path) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    std::memcpy(address.sun_path, socket.c_str(), socket.size() + 1);
+    return true;
+}
+
+} // namespace
+
+std::string defaultDaemonSocket() {
+    const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime != '\0') {
+        return std::string(runtime) + "/slug.sock";
+    }
+    return "/tmp/slug-" + std::to_string(::getuid()) + ".sock";
+}
+
+bool daemonCompiles(const std::vector<std::string> &args) {
+    if (args.empty() || args.front() == "run") {
+        return false;
+    }
+    for (const std::string &arg : args) {
+        if (arg == "-" || arg == "--help" || arg == "--version" ||
+            arg.compare(0, 8, "--daemon") == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::optional<int> forwardToDaemon(const std::string &socket,
+                                   const std::vector<std::string> &args) {
+    std::error_code ec;
+    std::filesystem::path workDir = std::filesystem::current_path(ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    int fd = connectTo(socket);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+
+    int status = 0;
+    std::string out;
+    std::string err;
+    try {
+        writeU32(fd, static_cast<std::uint32_t>(args.size()));
+        writeString(fd, workDir.string());
+        for (const std::string &arg : args) {
+            writeString(fd, arg);
+        }
+
+        // a daemon that dies halfway leaves the compile to the client
+        status = static_cast<std::int32_t>(readU32(fd));
+        out = readString(fd, UINT32_MAX);
+        err = readString(fd, UINT32_MAX);
+    } catch (const std::exception &) {
+        ::close(fd);
+        return std::nullopt;
+    }
+    ::close(fd);
+
+    std::cout << out << std::flush;
+    std::cerr << err << std::flush;
+    return status;
+}
+
+void writeU32(int fd, std::uint32_t value) {
+    char raw[sizeof value];
+    std::memcpy(raw, &value, sizeof value);
+    writeAll(fd, raw, sizeof value);
+}
+
+void writeString(int fd, const std::string &text) {
+    writeU32(fd, static_cast<std::uint32_t>(text.size()));
+    writeAll(fd, text.data(), text.size());
+}
+
+std::uint32_t readU32(int fd) {
+    std::uint32_t value;
+    char raw[sizeof value];
+    readAll(fd, raw, sizeof value);
+    std::memcpy(&value, raw, sizeof value);
+    return value;
+}
+
+std::string readString(int fd, std::uint32_t limit) {
+    std::uint32_t size = readU32(fd);
+    if (size > limit) {
+        throw std::runtime_error("Message too long");
+    }
+    std::string text(size, '\0');
+    readAll(fd, text.data(), size);
+    return text;
+}
+
+int listenOn(const std::string &socket) {
+    sockaddr_un address;
+    if (!socketAddress(socket, address)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // only the owner may connect, as requests write files as the owner
+    if (::bind(fd, reinterpret_cast<const sockaddr *>(&address),
+               sizeof address) != 0 ||
+        ::chmod(socket.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
+
+int connectTo(const std::string &socket) {
+    sockaddr_un address;
+    if (!socketAddress(socket, address)) {
+        return -1;
+    }
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&address),
+                  sizeof address) != 0) {
+        int error = errno;
+        ::close(fd);
+        errno = error;
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,211 @@
+#include "compilerOptions.hpp"
+#include "diskCache.hpp"
+#include "target.hpp"
+#include "version.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <link.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/CachePruning.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Host.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+namespace {
+
+// a temporary this old was left behind by a store that never finished
+constexpr std::chrono::hours staleTemporary(1);
+
+// the GNU build ID the linker put in the executable, empty if it has none
+std::string executableBuildId() {
+    std::string id;
+    dl_iterate_phdr(
+        [](dl_phdr_info *info, std::size_t, void *data) {
+            for (ElfW(Half) i = 0; i < info->dlpi_phnum; ++i) {
+                const ElfW(Phdr) &segment = info->dlpi_phdr[i];
+                if (segment.p_type != PT_NOTE) {
+                    continue;
+                }
+                std::size_t align =
+                    std::max<std::size_t>(segment.p_align, 4);
+                auto padded = [align](std::size_t size) {
+                    return (size + align - 1) / align * align;
+                };
+                const char *note = reinterpret_cast<const char *>(
+                    info->dlpi_addr + segment.p_vaddr);
+                const char *end = note + segment.p_memsz;
+                while (note + sizeof(ElfW(Nhdr)) <= end) {
+                    auto header = reinterpret_cast<const ElfW(Nhdr) *>(note);
+                    const char *name = note + sizeof(ElfW(Nhdr));
+                    const char *desc = name + padded(header->n_namesz);
+                    if (header->n_type == NT_GNU_BUILD_ID &&
+                        header->n_namesz == 4 &&
+                        std::memcmp(name, "GNU", 4) == 0) {
+                        *static_cast<std::string *>(data) = llvm::toHex(
+                            llvm::StringRef(desc, header->n_descsz),
+                            /*LowerCase=*/true);
+                        return 1;
+                    }
+                    note = desc + padded(header->n_descsz);
+                }
+            }
+            // the executable comes first, and libraries are not the compiler
+            return 1;
+        },
+        &id);
+    return id;
+}
+
+// Identifies the compiler build, so that a cache never hands out code an
+// older build generated. Without a build ID the executable itself is
+// hashed, once per process.
+const std::string &compilerBuild() {
+    static const std::string build = [] {
+        std::string id = executableBuildId();
+        if (!id.empty()) {
+            return id;
+        }
+        llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> executable =
+            llvm::MemoryBuffer::getFile("/proc/self/exe");
+        if (!executable) {
+            throw std::runtime_error(
+                "Cannot identify the compiler build for caching: " +
+                executable.getError().message());
+        }
+        return hashBytes((*executable)->getBuffer());
+    }();
+    return build;
+}
+
+} // namespace
+
+DiskCache::DiskCache(std::string directory, std::uint64_t maxBytes)
+    : directory(std::move(directory)), maxBytes(maxBytes) {
+    if (std::error_code ec =
+            llvm::sys::fs::create_directories(this->directory)) {
+        throw std::runtime_error("Cannot create cache directory `" +
+                                 this->directory + "`: " + ec.message());
+    }
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+DiskCache::load(const std::string &key) const {
+    std::string file = this->path(key);
+    llvm::Expected<llvm::sys::fs::file_t> fd =
+        llvm::sys::fs::openNativeFileForRead(file);
+    if (!fd) {
+        llvm::consumeError(fd.takeError());
+        return nullptr;
+    }
+
+    // read rather than mapped, as another process may replace or evict it
+    llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> contents =
+        llvm::MemoryBuffer::getOpenFile(*fd, file, /*FileSize=*/-1,
+                                        /*RequiresNullTerminator=*/false,
+                                        /*IsVolatile=*/true);
+
+    // the access time is what pruning goes by, and filesystems mounted with
+    // relatime or noatime do not keep it up to date by themselves
+    llvm::sys::fs::file_status status;
+    if (contents && !llvm::sys::fs::status(*fd, status)) {
+        llvm::sys::fs::setLastAccessAndModificationTime(
+            *fd, std::chrono::system_clock::now(),
+            status.getLastModificationTime());
+    }
+    llvm::sys::fs::closeFile(*fd);
+
+    if (!contents) {
+        return nullptr;
+    }
+    return std::move(*contents);
+}
+
+void DiskCache::store(const std::string &key, llvm::StringRef contents) const {
+    llvm::SmallString<128> temporary;
+    llvm::sys::fs::createUniquePath(this->directory + "/" + key +
+                                        ".%%%%%%%%.tmp",
+                                    temporary, /*MakeAbsolute=*/false);
+    std::string file = temporary.str().str();
+
+    std::error_code ec;
+    {
+        llvm::raw_fd_ostream os(file, ec, llvm::sys::fs::OF_None);
+        if (!ec) {
+            os << contents;
+            os.close();
+            ec = os.error();
+        }
+    }
+    // another process may have stored the same key meanwhile, with the same
+    // contents; either file can win
+    if (!ec) {
+        ec = llvm::sys::fs::rename(file, this->path(key));
+    }
+    if (ec) {
+        llvm::sys::fs::remove(file);
+        throw std::runtime_error("Cannot store `" + this->path(key) +
+                                 "` in the cache: " + ec.message());
+    }
+}
+
+void DiskCache::prune() const {
+    llvm::CachePruningPolicy policy;
+    policy.Interval = std::chrono::seconds(0); // every time
+    policy.Expiration = std::chrono::seconds(0); // only by size
+    policy.MaxSizeBytes = this->maxBytes;
+    llvm::pruneCache(this->directory, policy);
+
+    // pruneCache only looks at entries, so sweep up the temporaries of
+    // stores that crashed; younger ones may still be being written
+    auto cutoff = std::chrono::system_clock::now() - staleTemporary;
+    std::error_code ec;
+    for (llvm::sys::fs::directory_iterator it(this->directory, ec), end;
+         it != end && !ec; it.increment(ec)) {
+        if (!llvm::StringRef(it->path()).ends_with(".tmp")) {
+            continue;
+        }
+        llvm::ErrorOr<llvm::sys::fs::basic_file_status> status =
+            it->status();
+        if (status && status->getLastModificationTime() < cutoff) {
+            llvm::sys::fs::remove(it->path());
+        }
+    }
+}
+
+std::string hashBytes(std::string_view bytes) {
+    return llvm::toHex(
+        llvm::SHA1::hash(llvm::arrayRefFromStringRef(
+            llvm::StringRef(bytes.data(), bytes.size()))),
+        /*LowerCase=*/true);
+}
+
+std::string codeFingerprint(const CompilerOptions &opts) {
+    TargetSelection target = selectTarget(opts);
+    std::string fingerprint;
+    llvm::raw_string_ostream os(fingerprint);
+    // every part ends in a newline, which none of them contains
+    os << slugVersion << "\n"
+       << compilerBuild() << "\n"
+       << LLVM_VERSION_STRING << "\n"
+       << llvm::sys::getDefaultTargetTriple() << "\n"
+       << target.cpu << "\n"
+       << target.features << "\n"
+       << static_cast<int>(opts.optLevel) << "\n"
+       << opts.hashCons << "\n";
+    return fingerprint;
+}
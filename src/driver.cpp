@@ -1,14 +1,111 @@
+#include "ast.hpp"
+#include "astContext.hpp"
 #include "astPrinter.hpp"
+#include "bytecode.hpp"
+#include "bytecodeCompiler.hpp"
 #include "codegen.hpp"
 #include "compilerOptions.hpp"
+#include "constantFolder.hpp"
+#include "daemonClient.hpp"
+#include "diskCache.hpp"
 #include "driver.hpp"
+#include "incrementalCodeGen.hpp"
+#include "interner.hpp"
+#include "jit.hpp"
 #include "lexer.hpp"
+#include "objectCache.hpp"
+#include "parallel.hpp"
+#include "parallelCodeGen.hpp"
+#include "parallelParser.hpp"
 #include "parser.hpp"
+#include "sourceFile.hpp"
+#include "tierUp.hpp"
+#include "tokenStream.hpp"
+#include "version.hpp"
+#include "vm.hpp"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
-#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_os_ostream.h>
+#include <memory>
+#include <numeric>
+#include <ostream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// a positive count, e.g. of jobs
+unsigned parseCount(const std::string &count, const std::string &what) {
+    unsigned value = 0;
+    auto [end, ec] =
+        std::from_chars(count.data(), count.data() + count.size(), value);
+    if (ec != std::errc() || end != count.data() + count.size() || value == 0) {
+        throw std::runtime_error("Invalid " + what + " `" + count + "`");
+    }
+    return value;
+}
+
+OptLevel parseOptLevel(const std::string &flag) {
+    if (flag == "-O" || flag == "-O2") {
+        return OptLevel::O2;
+    } else if (flag == "-O0") {
+        return OptLevel::O0;
+    } else if (flag == "-O1") {
+        return OptLevel::O1;
+    } else if (flag == "-O3") {
+        return OptLevel::O3;
+    } else if (flag == "-Os") {
+        return OptLevel::Os;
+    } else if (flag == "-Oz") {
+        return OptLevel::Oz;
+    }
+    throw std::runtime_error("Unknown optimization level `" + flag + "`");
+}
+
+// Runs main and reports how long getting to it took against running it.
+template <typename Main>
+int runTimed(std::chrono::steady_clock::time_point start, std::ostream &err,
+             Main &&main) {
+    auto compiled = std::chrono::steady_clock::now();
+    int status = main();
+    auto finished = std::chrono::steady_clock::now();
+
+    using Millis = std::chrono::duration<double, std::milli>;
+    err << std::fixed << std::setprecision(3)
+        << "compile: " << Millis(compiled - start).count()
+        << " ms, execute: " << Millis(finished - compiled).count() << " ms"
+        << std::endl;
+    return status;
+}
+
+// a path from the command line, which is relative to opts.workDir
+std::string inWorkDir(const CompilerOptions &opts, const std::string &path) {
+    return (std::filesystem::path(opts.workDir) / path).string();
+}
+
+// `dir/name.slg` is compiled to `name.o` when compiling several files
+std::string objectFile(const std::string &source) {
+    return std::filesystem::path(source)
+        .filename()
+        .replace_extension(".o")
+        .string();
+}
+
+} // namespace
 
 CompilerOptions Driver::parseArgs(int argc, char **argv) {
     if (argc < 2) {
@@ -16,6 +113,7 @@ CompilerOptions Driver::parseArgs(int argc, char **argv) {
     }
 
     CompilerOptions opts;
+    bool jobsGiven = false;
 
     for (int i = 1; i < argc; ++i) {
         std::string str = argv[i];
@@ -24,54 +122,340 @@ CompilerOptions Driver::parseArgs(int argc, char **argv) {
             throw std::runtime_error("Incorrect usage");
         }
 
-        if (str.length() < std::string(".slg").length()) {
-            throw std::runtime_error("Incorrect usage");
-        }
-
-        if (str.substr(str.length() - 4, 4) != ".slg") {
-            throw std::runtime_error("Incorrect file extension");
-        }
-
-        if (str.at(0) == '-') { // flag
+        if (i == 1 && str == "run") { // slug run file.slg
+            opts.run = true;
+        } else if (str == "-") { // source from stdin
+            opts.infiles.push_back(str);
+        } else if (str.at(0) == '-') { // flag
             if (str == "--help") {
                 this->showHelp();
                 throw HelpException();
             } else if (str == "--version") {
                 this->showVersion();
                 throw VersionException();
+            } else if (str.compare(0, 7, "-march=") == 0 ||
+                       str.compare(0, 6, "-mcpu=") == 0) {
+                opts.cpu = str.substr(str.find('=') + 1);
+                if (opts.cpu.empty()) {
+                    throw std::runtime_error("Missing CPU in `" + str + "`");
+                }
+            } else if (str.compare(0, 7, "-mattr=") == 0) {
+                if (!opts.features.empty()) {
+                    opts.features += ',';
+                }
+                opts.features += str.substr(7);
+            } else if (str.compare(0, 2, "-O") == 0) {
+                opts.optLevel = parseOptLevel(str);
+            } else if (str == "--interp") {
+                opts.interp = true;
+            } else if (str == "--tiered") {
+                opts.tiered = true;
+            } else if (str.compare(0, 17, "--tier-threshold=") == 0) {
+                opts.tiered = true;
+                opts.tierThreshold =
+                    parseCount(str.substr(17), "tier-up threshold");
+            } else if (str == "--tier-stats") {
+                opts.tiered = true;
+                opts.tierStats = true;
+            } else if (str.compare(0, 12, "--cache-dir=") == 0) {
+                opts.cacheDir = str.substr(12);
+                if (opts.cacheDir.empty()) {
+                    throw std::runtime_error("Missing directory in `" + str +
+                                             "`");
+                }
+            } else if (str.compare(0, 13, "--cache-size=") == 0) {
+                opts.cacheSize = parseCount(str.substr(13), "cache size");
+            } else if (str == "--hash-cons") {
+                opts.hashCons = true;
+            } else if (str.compare(0, 2, "-j") == 0) { // -jN or -j N
+                std::string count = str.substr(2);
+                if (count.empty() && i + 1 < argc) {
+                    count = argv[++i];
+                }
+                opts.jobs = parseCount(count, "job count");
+                jobsGiven = true;
+            } else if (str == "--daemon" ||
+                       str.compare(0, 9, "--daemon=") == 0) {
+                opts.daemonSocket = str == "--daemon" ? defaultDaemonSocket()
+                                                      : str.substr(9);
+                if (opts.daemonSocket.empty()) {
+                    throw std::runtime_error("Missing socket in `" + str +
+                                             "`");
+                }
             } else {
                 throw std::runtime_error("Unknown flag `" + str + "`");
             }
         } else { // filename
-            opts.infile = str;
+            if (str.length() < std::string(".slg").length()) {
+                throw std::runtime_error("Incorrect usage");
+            }
+
+            if (str.substr(str.length() - 4, 4) != ".slg") {
+                throw std::runtime_error("Incorrect file extension");
+            }
+
+            opts.infiles.push_back(str);
+        }
+    }
+
+    if (!opts.daemonSocket.empty()) {
+        if (opts.run || !opts.infiles.empty()) {
+            throw std::runtime_error("`--daemon` takes no source files");
+        }
+        if (!jobsGiven) {
+            opts.jobs = std::max(1u, std::thread::hardware_concurrency());
+        }
+        return opts;
+    }
+
+    if (opts.infiles.empty()) {
+        throw std::runtime_error("Incorrect usage");
+    }
+    opts.infile = opts.infiles.front();
+    if (opts.infiles.size() > 1) {
+        if (opts.run) {
+            throw std::runtime_error("`slug run` takes a single source file");
+        }
+        // every file gets its object in the current directory
+        std::unordered_map<std::string, std::string> sources;
+        for (const std::string &file : opts.infiles) {
+            if (file == "-") {
+                throw std::runtime_error(
+                    "`-` cannot be compiled along with other files");
+            }
+            auto [seen, added] = sources.emplace(objectFile(file), file);
+            if (!added) {
+                throw std::runtime_error("Both `" + seen->second + "` and `" +
+                                         file + "` would be compiled to `" +
+                                         seen->first + "`");
+            }
         }
     }
+    if (opts.interp && !opts.run) {
+        throw std::runtime_error("`--interp` only applies to `slug run`");
+    }
+    if (opts.tiered && !opts.run) {
+        throw std::runtime_error("`--tiered` only applies to `slug run`");
+    }
+    if (!opts.cacheDir.empty() && (opts.interp || opts.tiered)) {
+        throw std::runtime_error(
+            "`--cache-dir` does not apply to `--interp` or `--tiered`");
+    }
+    if (opts.tiered && opts.interp) {
+        throw std::runtime_error("`--tiered` and `--interp` are exclusive");
+    }
 
     return opts;
 }
 
-void Driver::compile(const CompilerOptions &opts) {
-    Lexer lexer;
-    auto tokens = lexer.lex(opts.infile);
+int Driver::compile(const CompilerOptions &opts, std::ostream &out,
+                    std::ostream &err) {
+    if (opts.infiles.size() > 1) {
+        return this->compileFiles(opts, out, err);
+    }
+    return this->compileFile(opts, out, err);
+}
+
+int Driver::compileFiles(const CompilerOptions &opts, std::ostream &out,
+                         std::ostream &err) {
+    struct Unit {
+        std::ostringstream out;
+        std::ostringstream err;
+        bool failed = false;
+    };
+    std::vector<Unit> units(opts.infiles.size());
+
+    // biggest first, so that no big file is left to run alone at the end
+    std::vector<std::uintmax_t> sizes;
+    for (const std::string &file : opts.infiles) {
+        std::error_code ec;
+        std::uintmax_t size =
+            std::filesystem::file_size(inWorkDir(opts, file), ec);
+        sizes.push_back(ec ? 0 : size);
+    }
+    std::vector<std::size_t> order(opts.infiles.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) {
+                         return sizes[a] > sizes[b];
+                     });
+
+    parallelFor(order.size(), opts.jobs, [&](std::size_t i) {
+        std::size_t f = order[i];
+        CompilerOptions fileOpts = opts;
+        fileOpts.infile = opts.infiles[f];
+        fileOpts.infiles = {fileOpts.infile};
+        fileOpts.outfile = inWorkDir(opts, objectFile(fileOpts.infile));
+        fileOpts.jobs = 1; // the files are what runs in parallel
+
+        Unit &unit = units[f];
+        try {
+            this->compileFile(fileOpts, unit.out, unit.err);
+        } catch (const std::exception &e) {
+            unit.err << fileOpts.infile << ": " << e.what() << "\n";
+            unit.failed = true;
+        }
+    });
+
+    // in command-line order, whichever finished first
+    int status = 0;
+    for (Unit &unit : units) {
+        out << unit.out.str() << std::flush;
+        err << unit.err.str() << std::flush;
+        if (unit.failed) {
+            status = -1;
+        }
+    }
+    return status;
+}
+
+int Driver::compileFile(const CompilerOptions &opts, std::ostream &out,
+                        std::ostream &err) {
+    auto start = std::chrono::steady_clock::now();
+
+    // a regular file is read once, for both the cache key and the lexer, so
+    // the code stored under a key is always that of the text it hashes
+    std::string path = inWorkDir(opts, opts.infile);
+    std::unique_ptr<SourceFile> source;
+    if (opts.infile != "-" && SourceFile::isRegularFile(path)) {
+        source = std::make_unique<SourceFile>(path);
+    }
 
-    Parser parser(tokens);
-    auto ast = parser.parse();
+    // a program that ran before starts from its machine code, without even
+    // being parsed again; stdin and pipes are never cached, as hashing them
+    // would consume them
+    std::unique_ptr<DiskCache> cache;
+    std::string key;
+    if (opts.run && !opts.cacheDir.empty() && source) {
+        cache = std::make_unique<DiskCache>(opts.cacheDir, opts.cacheSize
+                                                               << 20);
+        key = hashBytes("jit\n" + codeFingerprint(opts) +
+                        std::string(source->text()));
+        if (std::unique_ptr<llvm::MemoryBuffer> object = cache->load(key)) {
+            JIT jit(opts);
+            jit.addObject(std::move(object));
+            return runTimed(start, err, jit.lookupMain());
+        }
+    }
 
-    ASTPrinter printer;
-    ast->accept(printer);
+    Interner interner;
+    Lexer lexer(interner);
+    if (source) {
+        lexer.open(std::move(source));
+    } else if (opts.infile == "-") {
+        lexer.open(std::cin);
+    } else {
+        lexer.open(path);
+    }
 
-    LLVMCodeGen codegen;
-    ast->accept(codegen);
+    ASTContext context;
+    if (opts.hashCons) {
+        context.enableHashConsing();
+    }
+    NodeId program;
+    if (opts.jobs > 1) {
+        ParallelParser parser(lexer, context, opts.jobs);
+        program = parser.parse();
+    } else {
+        TokenStream tokens(lexer);
+        Parser parser(tokens, context);
+        program = parser.parse();
+    }
+
+    if (!opts.run) {
+        ASTPrinter printer(interner, context, out);
+        printer.print(program);
+    }
+
+    ConstantFolder folder(interner, context);
+    folder.fold(program);
+
+    // the interpreter never touches LLVM, which is what makes it start fast;
+    // when tiered, LLVM only runs in the background once something is hot
+    if (opts.interp || opts.tiered) {
+        BytecodeCompiler compiler(interner, context);
+        BytecodeModule module = compiler.compile(program);
+        VM vm(module);
+
+        std::unique_ptr<TierUp> tierUp;
+        if (opts.tiered) {
+            tierUp = std::make_unique<TierUp>(interner, context, program,
+                                              module, vm, opts);
+            vm.setTierUp(opts.tierThreshold, [&tierUp](std::uint32_t fn) {
+                tierUp->request(fn);
+            });
+        }
+
+        int status = runTimed(start, err, [&vm] { return vm.run(); });
+        if (tierUp) {
+            tierUp->finish();
+            if (opts.tierStats) {
+                tierUp->dumpStats(err);
+            }
+        }
+        return status;
+    }
+
+    llvm::raw_os_ostream irOut(out);
+    llvm::raw_os_ostream errOut(err);
+
+    if (!opts.run && !opts.cacheDir.empty()) {
+        IncrementalCodeGen codegen(interner, context, opts);
+        codegen.compile(program, irOut, errOut);
+        return 0;
+    }
+
+    // more jobs also compile the program in parts, one object file each
+    if (!opts.run && opts.jobs > 1) {
+        ParallelCodeGen codegen(interner, context, opts);
+        codegen.compile(program, irOut, errOut);
+        return 0;
+    }
+
+    LLVMCodeGen codegen(interner, context, opts);
+    codegen.redirectDumps(irOut, errOut);
+    codegen.generate(program);
+    codegen.optimize();
+
+    if (opts.run) {
+        std::unique_ptr<DiskObjectCache> objectCache;
+        if (cache) {
+            codegen.getModule()->setModuleIdentifier(key);
+            objectCache = std::make_unique<DiskObjectCache>(*cache);
+        }
+        JIT jit(opts, /*lazy=*/false, objectCache.get());
+        jit.addModule(codegen.takeModule());
+        JIT::MainFn mainFn = jit.lookupMain();
+        return runTimed(start, err, mainFn);
+    }
 
-    codegen.dumpIR();
+    codegen.dumpIR(irOut);
 
     codegen.emitObjectFile(opts.outfile);
+    return 0;
 }
 
 void Driver::showHelp() {
-    std::cout << "slug language compiler help" << std::endl;
+    std::cout
+        << "slug language compiler help\n"
+        << "\n"
+        << "usage: slug [options] file.slg...\n"
+        << "       slug run [options] file.slg\n"
+        << "       slug --daemon[=SOCKET] [-jN]\n"
+        << "\n"
+        << "  -O0 .. -O3, -Os, -Oz    optimization level\n"
+        << "  -march=CPU, -mattr=F    target CPU and features\n"
+        << "  -jN                     use N threads; one source is compiled\n"
+        << "                          as up to N parts, each written to\n"
+        << "                          a.out.<part>.o when there are several\n"
+        << "  --cache-dir=DIR         reuse compiled code kept in DIR\n"
+        << "  --cache-size=N          keep DIR below N MiB\n"
+        << "  --hash-cons             share identical subexpressions\n"
+        << "  --interp, --tiered      run on the bytecode VM\n"
+        << std::flush;
 }
 
 void Driver::showVersion() {
-    std::cout << "slug language compiler version" << std::endl;
+    std::cout << "slug language compiler version " << slugVersion
+              << std::endl;
 }
@@ -0,0 +1,364 @@
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "codegen.hpp"
+#include "compilerOptions.hpp"
+#include "diskCache.hpp"
+#include "incrementalCodeGen.hpp"
+#include "interner.hpp"
+#include "parallel.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Object/ArchiveWriter.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/Triple.h>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace {
+
+// Hashes what the code of a unit depends on. Everything is written with
+// its length or arity, so that different inputs never run together.
+class UnitHasher {
+  public:
+    UnitHasher(const Interner &interner, const ASTContext &ast,
+               NodeId program, const CompilerOptions &opts)
+        : interner(interner), ast(ast) {
+        for (NodeId stmt : ast.stmts(program)) {
+            if (ast.kind(stmt) == NodeKind::Fn) {
+                this->functions.emplace(ast.fn(stmt).name, &ast.fn(stmt));
+            } else if (ast.kind(stmt) == NodeKind::Let) {
+                this->globals.emplace(ast.let(stmt).name, &ast.let(stmt));
+                this->globalOrder.push_back(&ast.let(stmt));
+            }
+        }
+
+        this->str(codeFingerprint(opts));
+        this->options = std::move(this->bytes);
+    }
+
+    std::string function(const FnDecl &fn) {
+        this->bytes = this->options;
+        this->str("fn");
+        this->str(this->interner.spelling(fn.name));
+        NodeList<FnParam> params = this->ast.params(fn);
+        this->u32(params.size());
+        for (const FnParam &param : params) {
+            this->str(this->interner.spelling(param.name));
+            this->u32(static_cast<std::uint32_t>(param.type.kind));
+        }
+        this->u32(static_cast<std::uint32_t>(fn.retType.kind));
+
+        // what the body names, sorted so the order of use does not matter
+        std::map<std::string_view, Symbol> callees;
+        std::map<std::string_view, Symbol> variables;
+        this->node(fn.body, &callees, &variables);
+
+        this->u32(callees.size());
+        for (const auto &[name, symbol] : callees) {
+            this->str(name);
+            auto callee = this->functions.find(symbol);
+            if (callee == this->functions.end()) {
+                this->u32(UINT32_MAX);
+                continue;
+            }
+            NodeList<FnParam> calleeParams = this->ast.params(*callee->second);
+            this->u32(calleeParams.size());
+            for (const FnParam &param : calleeParams) {
+                this->u32(static_cast<std::uint32_t>(param.type.kind));
+            }
+            this->u32(static_cast<std::uint32_t>(callee->second->retType.kind));
+        }
+
+        // may be locals that shadow nothing; hashing them too is harmless
+        for (const auto &[name, symbol] : variables) {
+            auto global = this->globals.find(symbol);
+            if (global != this->globals.end()) {
+                this->global(*global->second);
+            }
+        }
+        return hashBytes(this->bytes);
+    }
+
+    std::string allGlobals() {
+        this->bytes = this->options;
+        this->str("globals");
+        this->u32(this->globalOrder.size());
+        for (const LetDecl *let : this->globalOrder) {
+            this->global(*let);
+        }
+        return hashBytes(this->bytes);
+    }
+
+  private:
+    const Interner &interner;
+    const ASTContext &ast;
+    std::unordered_map<Symbol, const FnDecl *> functions;
+    std::unordered_map<Symbol, const LetDecl *> globals;
+    std::vector<const LetDecl *> globalOrder;
+    std::string options;
+    std::string bytes;
+
+    void u32(std::uint32_t value) {
+        char raw[sizeof value];
+        std::memcpy(raw, &value, sizeof value);
+        this->bytes.append(raw, sizeof value);
+    }
+    void str(std::string_view text) {
+        this->u32(text.size());
+        this->bytes.append(text.data(), text.size());
+    }
+
+    void global(const LetDecl &let) {
+        this->str(this->interner.spelling(let.name));
+        this->u32(let.mut);
+        this->u32(static_cast<std::uint32_t>(let.type.kind));
+        this->node(let.initializer, nullptr, nullptr);
+    }
+
+    // Writes a tree in pre-order, walking it with an explicit stack like the
+    // other passes, and collects the names it calls and reads.
+    void node(NodeId root, std::map<std::string_view, Symbol> *callees,
+              std::map<std::string_view, Symbol> *variables) {
+        std::vector<NodeId> todo{root};
+        while (!todo.empty()) {
+            NodeId id = todo.back();
+            todo.pop_back();
+            if (id == noNode) {
+                this->u32(UINT32_MAX);
+                continue;
+            }
+
+            this->u32(static_cast<std::uint32_t>(this->ast.kind(id)));
+            switch (this->ast.kind(id)) {
+            case NodeKind::Literal: {
+                Literal::Value value = this->ast.literal(id).get();
+                this->u32(value.index());
+                std::visit(
+                    [this](auto v) {
+                        char raw[sizeof v];
+                        std::memcpy(raw, &v, sizeof v);
+                        this->bytes.append(raw, sizeof v);
+                    },
+                    value);
+                break;
+            }
+            case NodeKind::Variable: {
+                Symbol name = this->ast.variable(id);
+                std::string_view spelling = this->interner.spelling(name);
+                this->str(spelling);
+                if (variables) {
+                    variables->emplace(spelling, name);
+                }
+                break;
+            }
+            case NodeKind::Binary:
+                this->u32(static_cast<std::uint32_t>(this->ast.binaryOp(id)));
+                todo.push_back(this->ast.rhs(id));
+                todo.push_back(this->ast.lhs(id));
+                break;
+            case NodeKind::Unary:
+                this->u32(static_cast<std::uint32_t>(this->ast.unaryOp(id)));
+                todo.push_back(this->ast.operand(id));
+                break;
+            case NodeKind::Call: {
+                Symbol callee = this->ast.callee(id);
+                std::string_view spelling = this->interner.spelling(callee);
+                this->str(spelling);
+                if (callees) {
+                    callees->emplace(spelling, callee);
+                }
+                NodeList<NodeId> args = this->ast.args(id);
+                this->u32(args.size());
+                for (std::size_t i = args.size(); i-- > 0;) {
+                    todo.push_back(args[i]);
+                }
+                break;
+            }
+            case NodeKind::ExpressionStmt:
+                todo.push_back(this->ast.expr(id));
+                break;
+            case NodeKind::Block:
+            case NodeKind::Program: {
+                NodeList<NodeId> stmts = this->ast.stmts(id);
+                this->u32(stmts.size());
+                for (std::size_t i = stmts.size(); i-- > 0;) {
+                    todo.push_back(stmts[i]);
+                }
+                break;
+            }
+            case NodeKind::Let: {
+                const LetDecl &let = this->ast.let(id);
+                this->str(this->interner.spelling(let.name));
+                this->u32(let.mut);
+                this->u32(static_cast<std::uint32_t>(let.type.kind));
+                todo.push_back(let.initializer);
+                break;
+            }
+            case NodeKind::Return:
+                todo.push_back(this->ast.returnValue(id));
+                break;
+            case NodeKind::Fn:
+                throw std::runtime_error("Nested function declarations are "
+                                         "not supported");
+            }
+        }
+    }
+};
+
+// a deterministic static archive for the host's linker
+void writeArchive(const std::string &file,
+                  const std::vector<llvm::NewArchiveMember> &members) {
+    llvm::Triple triple(llvm::sys::getDefaultTargetTriple());
+    llvm::object::Archive::Kind kind = triple.isOSDarwin()
+                                           ? llvm::object::Archive::K_DARWIN
+                                           : llvm::object::Archive::K_GNU;
+    if (llvm::Error error = llvm::writeArchive(
+            file, members, llvm::SymtabWritingMode::NormalSymtab, kind,
+            /*Deterministic=*/true, /*Thin=*/false)) {
+        throw std::runtime_error("Cannot write `" + file +
+                                 "`: " + llvm::toString(std::move(error)));
+    }
+}
+
+} // namespace
+
+IncrementalCodeGen::IncrementalCodeGen(const Interner &interner,
+                                       const ASTContext &ast,
+                                       const CompilerOptions &opts)
+    : interner(interner), ast(ast), opts(opts),
+      cache(opts.cacheDir, opts.cacheSize << 20) {}
+
+void IncrementalCodeGen::compile(NodeId program, llvm::raw_ostream &out,
+                                 llvm::raw_ostream &err) {
+    struct Unit {
+        std::size_t first = 0; // function bodies of top-level statements
+        std::size_t last = 0;  // [first, last)
+        bool globals = false;
+        std::string key;
+        std::unique_ptr<llvm::MemoryBuffer> object; // null until compiled
+        std::string ir;
+        std::string scopes;
+        std::exception_ptr error;
+    };
+    std::vector<Unit> units;
+    auto addUnit = [&units](std::size_t first, std::size_t last, bool globals,
+                            std::string key) {
+        Unit &unit = units.emplace_back();
+        unit.first = first;
+        unit.last = last;
+        unit.globals = globals;
+        unit.key = std::move(key);
+    };
+    UnitHasher hasher(this->interner, this->ast, program, this->opts);
+
+    // the globals first, as codegen declares them before any function
+    NodeList<NodeId> stmts = this->ast.stmts(program);
+    for (NodeId stmt : stmts) {
+        if (this->ast.kind(stmt) == NodeKind::Let) {
+            addUnit(0, 0, true, hasher.allGlobals());
+            break;
+        }
+    }
+
+    bool hasMain = false;
+    std::string runKeys;
+    std::size_t runStart = 0;
+    std::size_t runLength = 0;
+    for (std::size_t i = 0; i < stmts.size(); ++i) {
+        if (this->ast.kind(stmts[i]) != NodeKind::Fn) {
+            continue;
+        }
+        const FnDecl &fn = this->ast.fn(stmts[i]);
+        if (this->interner.spelling(fn.name) == "main") {
+            hasMain = true;
+        }
+        if (runLength++ == 0) {
+            runStart = i;
+        }
+        std::string key = hasher.function(fn);
+        runKeys += key;
+        if (std::stoul(key.substr(0, 8), nullptr, 16) % functionsPerUnit ==
+                0 ||
+            runLength == maxFunctionsPerUnit) {
+            addUnit(runStart, i + 1, false, hashBytes(runKeys));
+            runKeys.clear();
+            runLength = 0;
+        }
+    }
+    if (runLength > 0) {
+        addUnit(runStart, stmts.size(), false, hashBytes(runKeys));
+    }
+
+    for (Unit &unit : units) {
+        unit.object = this->cache.load(unit.key);
+    }
+
+    LLVMCodeGen::FunctionIndex functions =
+        LLVMCodeGen::indexFunctions(this->ast, program);
+    parallelFor(units.size(), this->opts.jobs, [&](std::size_t u) {
+        Unit &unit = units[u];
+        if (unit.object) {
+            return;
+        }
+        // threads must not share the streams
+        llvm::raw_string_ostream os(unit.ir);
+        llvm::raw_string_ostream scopeDump(unit.scopes);
+        try {
+            LLVMCodeGen codegen(this->interner, this->ast, this->opts);
+            codegen.setPartition(unit.first, unit.last, unit.globals,
+                                 functions);
+            codegen.redirectDumps(os, scopeDump);
+            codegen.generate(program);
+            codegen.optimize();
+            codegen.dumpIR(os);
+            llvm::SmallVector<char, 0> object;
+            llvm::raw_svector_ostream objectStream(object);
+            codegen.emitObject(objectStream);
+            llvm::StringRef contents(object.data(), object.size());
+            this->cache.store(unit.key, contents);
+            unit.object = llvm::MemoryBuffer::getMemBufferCopy(contents);
+        } catch (...) {
+            unit.error = std::current_exception();
+        }
+    });
+
+    // the first error in program order, like a whole-program compile
+    for (const Unit &unit : units) {
+        if (unit.error) {
+            out << unit.ir;
+            err << unit.scopes;
+            std::rethrow_exception(unit.error);
+        }
+    }
+    if (!hasMain) {
+        throw std::runtime_error("Program is missing 'fn main(): void");
+    }
+
+    this->cache.prune();
+
+    std::vector<std::string> names;
+    names.reserve(units.size()); // the members point into the names
+    std::vector<llvm::NewArchiveMember> members;
+    for (const Unit &unit : units) {
+        out << unit.ir;
+        names.push_back(unit.key + ".o");
+        members.emplace_back(unit.object->getMemBufferRef());
+        members.back().MemberName = names.back();
+    }
+    writeArchive(this->opts.outfile, members);
+}
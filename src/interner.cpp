@@ -0,0 +1,74 @@
+#include "interner.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <utility>
+
+Symbol Interner::intern(std::string_view name) {
+    std::uint64_t h = hash(name);
+    std::size_t mask = this->slots.size() - 1;
+
+    for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+        std::uint32_t sym = this->slots[i];
+        if (sym == emptySlot) {
+            sym = static_cast<Symbol>(this->names.size());
+            this->names.push_back(this->store(name));
+            this->hashes.push_back(h);
+            this->slots[i] = sym;
+
+            // keep the load factor under 1/2
+            if (this->names.size() * 2 > this->slots.size()) {
+                this->grow();
+            }
+            return sym;
+        }
+        if (this->hashes[sym] == h && this->names[sym] == name) {
+            return sym;
+        }
+    }
+}
+
+// FNV-1a
+std::uint64_t Interner::hash(std::string_view name) {
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : name) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+std::string_view Interner::store(std::string_view name) {
+    if (name.size() > this->chunkLeft) {
+        std::size_t size = std::max(chunkSize, name.size());
+        this->chunks.push_back(std::make_unique<char[]>(size));
+        this->chunkPtr = this->chunks.back().get();
+        this->chunkLeft = size;
+    }
+
+    char *dst = this->chunkPtr;
+    std::memcpy(dst, name.data(), name.size());
+    this->chunkPtr += name.size();
+    this->chunkLeft -= name.size();
+
+    return std::string_view(dst, name.size());
+}
+
+void Interner::grow() {
+    std::vector<std::uint32_t> bigger(this->slots.size() * 2, emptySlot);
+    std::size_t mask = bigger.size() - 1;
+
+    for (Symbol sym = 0; sym < this->names.size(); ++sym) {
+        std::size_t i = this->hashes[sym] & mask;
+        while (bigger[i] != emptySlot) {
+            i = (i + 1) & mask;
+        }
+        bigger[i] = sym;
+    }
+
+    this->slots = std::move(bigger);
+}
@@ -0,0 +1,133 @@
+#include "bytecode.hpp"
+#include "compilerOptions.hpp"
+#include "jit.hpp"
+#include "target.hpp"
+
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/Orc/CompileUtils.h>
+#include <llvm/ExecutionEngine/Orc/Core.h>
+#include <llvm/ExecutionEngine/Orc/IRCompileLayer.h>
+#include <llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h>
+#include <llvm/ExecutionEngine/Orc/LLJIT.h>
+#include <llvm/ExecutionEngine/Orc/ThreadSafeModule.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/TargetParser/Host.h>
+#include <llvm/TargetParser/Triple.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+void check(llvm::Error err) {
+    if (err) {
+        throw std::runtime_error("JIT: " + llvm::toString(std::move(err)));
+    }
+}
+
+template <typename T> T check(llvm::Expected<T> value) {
+    check(value.takeError());
+    return std::move(*value);
+}
+
+} // namespace
+
+JIT::JIT(const CompilerOptions &opts, bool lazy, llvm::ObjectCache *cache)
+    : lazy(lazy) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+
+    TargetSelection target = selectTarget(opts);
+
+    llvm::orc::JITTargetMachineBuilder machine(
+        llvm::Triple(llvm::sys::getProcessTriple()));
+    machine.setCPU(target.cpu);
+    std::vector<std::string> features;
+    for (std::size_t start = 0; start < target.features.size();) {
+        std::size_t end = target.features.find(',', start);
+        if (end == std::string::npos) {
+            end = target.features.size();
+        }
+        features.push_back(target.features.substr(start, end - start));
+        start = end + 1;
+    }
+    machine.addFeatures(features);
+    machine.setCodeGenOptLevel(codeGenOptLevel(opts.optLevel));
+
+    if (lazy) {
+        // stubs compile on whichever thread calls them, so compiles can
+        // overlap; give each its own TargetMachine
+        auto compiler = [](llvm::orc::JITTargetMachineBuilder builder)
+            -> llvm::Expected<
+                std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+            return std::make_unique<llvm::orc::ConcurrentIRCompiler>(
+                std::move(builder));
+        };
+        this->jit = check(llvm::orc::LLLazyJITBuilder()
+                              .setJITTargetMachineBuilder(std::move(machine))
+                              .setCompileFunctionCreator(compiler)
+                              .create());
+    } else if (cache) {
+        // a module is compiled on the thread that looks it up, so one
+        // TargetMachine is enough
+        auto compiler = [cache](llvm::orc::JITTargetMachineBuilder builder)
+            -> llvm::Expected<
+                std::unique_ptr<llvm::orc::IRCompileLayer::IRCompiler>> {
+            auto targetMachine = builder.createTargetMachine();
+            if (!targetMachine) {
+                return targetMachine.takeError();
+            }
+            return std::make_unique<llvm::orc::TMOwningSimpleCompiler>(
+                std::move(*targetMachine), cache);
+        };
+        this->jit = check(llvm::orc::LLJITBuilder()
+                              .setJITTargetMachineBuilder(std::move(machine))
+                              .setCompileFunctionCreator(compiler)
+                              .create());
+    } else {
+        this->jit = check(llvm::orc::LLJITBuilder()
+                              .setJITTargetMachineBuilder(std::move(machine))
+                              .create());
+    }
+}
+
+void JIT::addModule(llvm::orc::ThreadSafeModule module) {
+    if (this->lazy) {
+        check(static_cast<llvm::orc::LLLazyJIT &>(*this->jit).addLazyIRModule(
+            std::move(module)));
+    } else {
+        check(this->jit->addIRModule(std::move(module)));
+    }
+}
+
+void JIT::addObject(std::unique_ptr<llvm::MemoryBuffer> object) {
+    check(this->jit->addObjectFile(std::move(object)));
+}
+
+JIT::MainFn JIT::lookupMain() {
+    return check(this->jit->lookup("main")).toPtr<MainFn>();
+}
+
+JIT::SlotEntry JIT::lookupSlotEntry(const std::string &fn) {
+    std::string symbol = fn + slotEntrySuffix;
+    auto entry = check(this->jit->lookup(symbol)).toPtr<SlotEntry>();
+    if (!this->lazy) {
+        return entry;
+    }
+
+    // what a lazy JIT hands out is a stub that compiles the function when
+    // it is first called; the on-demand layer keeps the real definitions in
+    // a dylib of its own, where looking the function up compiles it now
+    llvm::orc::JITDylib *impl =
+        this->jit->getExecutionSession().getJITDylibByName(
+            this->jit->getMainJITDylib().getName() + ".impl");
+    if (!impl) {
+        return entry;
+    }
+    return check(this->jit->lookup(*impl, symbol)).toPtr<SlotEntry>();
+}
@@ -1,34 +1,78 @@
+#include "charScan.hpp"
+#include "keywords.hpp"
 #include "lexer.hpp"
 #include "token.hpp"
 
 #include <cctype>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
 #include <fstream>
+#include <istream>
+#include <memory>
 #include <optional>
-#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
-std::vector<Token> Lexer::lex(const std::string &infile) {
-    this->src = this->readFile(infile);
-    while (!this->isAtEnd()) {
+void Lexer::open(const std::string &infile) {
+    if (SourceFile::isRegularFile(infile)) {
+        this->open(std::make_unique<SourceFile>(infile));
+        return;
+    }
+
+    auto stream = std::make_unique<std::ifstream>(infile, std::ios::binary);
+    if (!stream->is_open()) {
+        throw std::runtime_error("File `" + infile + "` not found");
+    }
+    this->ownedStream = std::move(stream);
+    this->open(*this->ownedStream);
+}
+
+void Lexer::open(std::unique_ptr<SourceFile> file) {
+    this->file = std::move(file);
+    this->src = this->file->text();
+}
+
+void Lexer::open(std::istream &in) {
+    this->in = &in;
+    this->buffer.clear();
+    this->src = this->buffer;
+}
+
+void Lexer::next(TokenStore &store) {
+    this->out = &store;
+
+    std::size_t end = store.end();
+    while (store.end() == end) {
         this->start = this->cur;
+        if (this->isAtEnd()) {
+            this->addToken(TokenType::Eof);
+            break;
+        }
         this->scanTokens();
     }
 
-    this->addToken(TokenType::Eof);
-
-    return this->tokens;
+    this->out = nullptr;
+    // a refill may have moved the buffer
+    store.setSource(this->src, this->base);
 }
 
 void Lexer::scanTokens() {
     char c = this->advance();
 
-    if (c == ' ' || c == '\r' || c == '\t') {
-        return;
-    }
-    if (c == '\n') {
-        this->line++;
+    if (c == ' ' || c == '\r' || c == '\t' || c == '\n') {
+        if (c == '\n') {
+            this->line++;
+        }
+        // swallow the rest of the run in one go
+        do {
+            this->cur +=
+                scanWhitespace(this->curPtr(), this->endPtr(), this->line);
+        } while (this->cur == (int)this->src.size() && this->refill());
         return;
     }
 
@@ -108,19 +152,55 @@ void Lexer::scanTokens() {
 
 void Lexer::addTokenWithLiteral(TokenType type,
                                 std::optional<Literal> literal) {
-    std::string lexeme = this->src.substr(this->start, this->cur - this->start);
-    this->tokens.emplace_back(type, lexeme, literal, this->line);
+    this->out->push(type, this->tokenOffset(), this->tokenLength(),
+                    this->line, literal);
+}
+
+void Lexer::addIdentifier(Symbol name) {
+    this->out->pushIdentifier(this->tokenOffset(), this->tokenLength(),
+                              this->line, name);
+}
+
+std::uint32_t Lexer::tokenOffset() const {
+    std::uint64_t offset = this->base + this->start;
+    if (offset + (this->cur - this->start) > UINT32_MAX) {
+        throw std::runtime_error("[line " + std::to_string(this->line) +
+                                 "] Input larger than 4 GiB");
+    }
+    return offset;
+}
+
+std::uint16_t Lexer::tokenLength() const {
+    std::size_t length = this->cur - this->start;
+    if (length > TokenStore::maxLength) {
+        throw std::runtime_error("[line " + std::to_string(this->line) +
+                                 "] Token longer than " +
+                                 std::to_string(TokenStore::maxLength) +
+                                 " characters");
+    }
+    return length;
 }
 
 void Lexer::addToken(TokenType type) {
     this->addTokenWithLiteral(type, std::nullopt);
 }
 
+// decimal: [0-9][0-9_]* ('.' [0-9][0-9_]*)? ([eE] [+-]? [0-9][0-9_]*)?
+// hex/binary integers: 0x[0-9a-fA-F_]+, 0b[01_]+
+// `_` separates digits and has to be followed by one
 void Lexer::number() {
-    while (std::isdigit(this->peek())) {
-        this->advance();
+    char next = this->peek();
+    if (this->src[this->start] == '0' &&
+        (next == 'x' || next == 'X' || next == 'b' || next == 'B')) {
+        int base = (next == 'x' || next == 'X') ? 16 : 2;
+        this->advance(); // consume the radix prefix
+        this->radixDigits(base);
+        this->integerLiteral(base);
+        return;
     }
 
+    this->decimalDigits();
+
     bool isFloat = false;
 
     if (this->peek() == '.' && std::isdigit(this->peekNext())) {
@@ -128,58 +208,180 @@ void Lexer::number() {
 
         this->advance(); // consume '.'
 
-        while (std::isdigit(this->peek())) {
-            this->advance();
-        }
+        this->decimalDigits();
     }
 
-    std::string lexeme = this->src.substr(this->start, this->cur - this->start);
+    next = this->peekNext();
+    if ((this->peek() == 'e' || this->peek() == 'E') &&
+        (std::isdigit(next) || next == '+' || next == '-')) {
+        isFloat = true;
+
+        this->advance(); // consume 'e'
+        if (!std::isdigit(this->peek())) {
+            this->advance(); // consume the sign
+        }
+        if (!std::isdigit(this->peek())) {
+            throw this->error("Expected digits in exponent");
+        }
+
+        this->decimalDigits();
+    }
 
     if (isFloat) {
-        double value = std::stod(lexeme);
-        this->addTokenWithLiteral(TokenType::Number, Literal(value));
+        this->floatLiteral();
     } else {
-        int value = std::stoi(lexeme);
-        this->addTokenWithLiteral(TokenType::Number, Literal(value));
+        this->integerLiteral(10);
+    }
+}
+
+void Lexer::decimalDigits() {
+    this->skipDigits();
+    while (this->match('_')) {
+        if (!std::isdigit(this->peek())) {
+            throw this->error("Digit separator must be followed by a digit");
+        }
+        this->skipDigits();
     }
 }
 
+void Lexer::radixDigits(int base) {
+    auto isRadixDigit = [base](char c) {
+        return base == 16 ? std::isxdigit(c) : (c == '0' || c == '1');
+    };
+
+    do {
+        if (!isRadixDigit(this->peek())) {
+            throw this->error("Expected digit in base " +
+                              std::to_string(base) + " literal");
+        }
+        while (isRadixDigit(this->peek())) {
+            this->advance();
+        }
+    } while (this->match('_'));
+}
+
+// Copies the digits of the current literal into `buf`, dropping separators
+// and the radix prefix, so they can be handed to std::from_chars without
+// allocating. Returns the number of characters written.
+std::size_t Lexer::literalDigits(char (&buf)[maxLiteralDigits], int base) {
+    std::string_view lexeme =
+        this->src.substr(this->start, this->cur - this->start);
+    if (base != 10) {
+        lexeme.remove_prefix(2);
+    }
+
+    std::size_t len = 0;
+    for (char c : lexeme) {
+        if (c == '_') {
+            continue;
+        }
+        if (len == maxLiteralDigits) {
+            throw this->error("Numeric literal too long");
+        }
+        buf[len++] = c;
+    }
+    return len;
+}
+
+// Decimal literals have to fit in i32. Hex and binary ones are bit patterns
+// and may use all 32 bits.
+void Lexer::integerLiteral(int base) {
+    char buf[maxLiteralDigits];
+    std::size_t len = this->literalDigits(buf, base);
+
+    std::uint64_t value = 0;
+    auto [end, ec] = std::from_chars(buf, buf + len, value, base);
+    (void)end;
+
+    if (ec == std::errc::result_out_of_range) {
+        std::string lexeme(
+            this->src.substr(this->start, this->cur - this->start));
+        throw this->error("Integer literal `" + lexeme +
+                          "` does not fit in 64 bits");
+    }
+    std::uint64_t max = base == 10 ? INT32_MAX : UINT32_MAX;
+    if (value > max) {
+        std::string lexeme(
+            this->src.substr(this->start, this->cur - this->start));
+        throw this->error("Integer literal `" + lexeme +
+                          "` is out of range for i32");
+    }
+
+    this->addTokenWithLiteral(
+        TokenType::Number,
+        Literal(static_cast<int>(static_cast<std::uint32_t>(value))));
+}
+
+void Lexer::floatLiteral() {
+    char buf[maxLiteralDigits];
+    std::size_t len = this->literalDigits(buf, 10);
+
+    double value = 0;
+    auto [end, ec] = std::from_chars(buf, buf + len, value);
+    (void)end;
+
+    if (ec == std::errc::result_out_of_range) {
+        std::string lexeme(
+            this->src.substr(this->start, this->cur - this->start));
+        throw this->error("Float literal `" + lexeme +
+                          "` is out of range for f64");
+    }
+
+    this->addTokenWithLiteral(TokenType::Number, Literal(value));
+}
+
+std::runtime_error Lexer::error(const std::string &msg) const {
+    return std::runtime_error("[line " + std::to_string(this->line) + "] " +
+                              msg);
+}
+
 void Lexer::identifier() {
-    while (std::isalnum(this->peek())) {
-        this->advance();
-    }
-
-    std::string lexeme = this->src.substr(this->start, this->cur - this->start);
-    if (lexeme == "true") {
-        this->addToken(TokenType::True);
-    } else if (lexeme == "false") {
-        this->addToken(TokenType::False);
-    } else if (lexeme == "fn") {
-        this->addToken(TokenType::Fn);
-    } else if (lexeme == "let") {
-        this->addToken(TokenType::Let);
-    } else if (lexeme == "mut") {
-        this->addToken(TokenType::Mut);
-    } else if (lexeme == "return") {
-        this->addToken(TokenType::Return);
+    do {
+        this->cur += scanAlnum(this->curPtr(), this->endPtr());
+    } while (this->cur == (int)this->src.size() && this->refill());
+
+    std::string_view lexeme =
+        this->src.substr(this->start, this->cur - this->start);
+
+    TokenType type = keywordType(lexeme);
+    if (type == TokenType::Identifier) {
+        this->addIdentifier(this->interner.intern(lexeme));
     } else {
-        this->addToken(TokenType::Identifier);
+        // true/false literals are implied by the token type
+        this->addToken(type);
     }
 }
 
-std::string Lexer::readFile(const std::string &infile) {
-    std::ifstream file(infile);
-    if (!file.is_open()) {
-        throw std::runtime_error("File `" + infile + "` not found");
+void Lexer::skipDigits() {
+    do {
+        this->cur += scanDigits(this->curPtr(), this->endPtr());
+    } while (this->cur == (int)this->src.size() && this->refill());
+}
+
+// Appends the next chunk of a streamed input to the buffer, first dropping
+// whatever precedes both the token being scanned and the released offset.
+// Returns false once the stream is exhausted (and always for mapped files).
+bool Lexer::refill() {
+    if (!this->in || !*this->in) {
+        return false;
     }
 
-    std::stringstream ss;
-    ss << file.rdbuf();
-    std::string str = ss.str();
+    std::size_t drop = this->start;
+    if (this->released < this->base + drop) {
+        drop = this->released > this->base ? this->released - this->base : 0;
+    }
+    this->buffer.erase(0, drop);
+    this->base += drop;
+    this->cur -= drop;
+    this->start -= drop;
 
-    file.close();
+    std::size_t size = this->buffer.size();
+    this->buffer.resize(size + chunkSize);
+    this->in->read(&this->buffer[size], chunkSize);
+    this->buffer.resize(size + this->in->gcount());
+    this->src = this->buffer;
 
-    return str;
+    return this->in->gcount() > 0;
 }
 
 char Lexer::advance() {
@@ -189,9 +391,12 @@ char Lexer::advance() {
 char Lexer::peek() { return (this->isAtEnd()) ? '\0' : this->src[this->cur]; }
 
 char Lexer::peekNext() {
-    return (this->cur + 1 >= (int)this->src.length())
-               ? '\0'
-               : this->src[this->cur + 1];
+    while (this->cur + 1 >= (int)this->src.length()) {
+        if (!this->refill()) {
+            return '\0';
+        }
+    }
+    return this->src[this->cur + 1];
 }
 
 bool Lexer::match(char expected) {
@@ -205,4 +410,6 @@ bool Lexer::match(char expected) {
     return true;
 }
 
-bool Lexer::isAtEnd() { return this->cur >= (int)this->src.length(); }
+bool Lexer::isAtEnd() {
+    return this->cur >= (int)this->src.length() && !this->refill();
+}
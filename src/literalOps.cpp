@@ -0,0 +1,151 @@
+#include "ast.hpp"
+#include "literal.hpp"
+#include "literalOps.hpp"
+#include "type.hpp"
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <variant>
+
+namespace {
+
+// i32 arithmetic is done in 64 bits and checked, so a result that would
+// wrap in LLVM is reported instead
+LiteralResult apply(BinaryOp op, int lhs, int rhs) {
+    std::int64_t l = lhs;
+    std::int64_t r = rhs;
+    std::int64_t result = 0;
+
+    switch (op) {
+    case BinaryOp::Add:
+        result = l + r;
+        break;
+    case BinaryOp::Sub:
+        result = l - r;
+        break;
+    case BinaryOp::Mul:
+        result = l * r;
+        break;
+    case BinaryOp::Div:
+    case BinaryOp::Mod:
+        if (r == 0) {
+            return {std::nullopt, "Division by zero"};
+        }
+        result = op == BinaryOp::Div ? l / r : l % r;
+        break;
+    case BinaryOp::Eq:
+        return {Literal(lhs == rhs)};
+    case BinaryOp::Neq:
+        return {Literal(lhs != rhs)};
+    case BinaryOp::Lt:
+        return {Literal(lhs < rhs)};
+    case BinaryOp::Lte:
+        return {Literal(lhs <= rhs)};
+    case BinaryOp::Gt:
+        return {Literal(lhs > rhs)};
+    case BinaryOp::Gte:
+        return {Literal(lhs >= rhs)};
+    }
+
+    // INT_MIN / -1 lands here too
+    if (result < INT_MIN || result > INT_MAX) {
+        return {std::nullopt, "Integer overflow"};
+    }
+    return {Literal(static_cast<int>(result))};
+}
+
+// f64 follows IEEE 754 like the emitted instructions: dividing by zero gives
+// an infinity or NaN, and every comparison with NaN is false
+LiteralResult apply(BinaryOp op, double lhs, double rhs) {
+    switch (op) {
+    case BinaryOp::Add:
+        return {Literal(lhs + rhs)};
+    case BinaryOp::Sub:
+        return {Literal(lhs - rhs)};
+    case BinaryOp::Mul:
+        return {Literal(lhs * rhs)};
+    case BinaryOp::Div:
+        return {Literal(lhs / rhs)};
+    case BinaryOp::Mod:
+        return {Literal(std::fmod(lhs, rhs))};
+    case BinaryOp::Eq:
+        return {Literal(lhs == rhs)};
+    case BinaryOp::Neq:
+        return {Literal(lhs < rhs || lhs > rhs)};
+    case BinaryOp::Lt:
+        return {Literal(lhs < rhs)};
+    case BinaryOp::Lte:
+        return {Literal(lhs <= rhs)};
+    case BinaryOp::Gt:
+        return {Literal(lhs > rhs)};
+    case BinaryOp::Gte:
+        return {Literal(lhs >= rhs)};
+    }
+    return {};
+}
+
+// only equality; codegen decides what the rest mean for i1
+LiteralResult apply(BinaryOp op, bool lhs, bool rhs) {
+    switch (op) {
+    case BinaryOp::Eq:
+        return {Literal(lhs == rhs)};
+    case BinaryOp::Neq:
+        return {Literal(lhs != rhs)};
+    default:
+        return {};
+    }
+}
+
+} // namespace
+
+LiteralResult applyBinary(BinaryOp op, const Literal &lhs,
+                          const Literal &rhs) {
+    Literal::Value l = lhs.get();
+    Literal::Value r = rhs.get();
+    if (l.index() != r.index()) {
+        return {};
+    }
+    return std::visit(
+        [&](auto lhsValue) {
+            return apply(op, lhsValue, std::get<decltype(lhsValue)>(r));
+        },
+        l);
+}
+
+LiteralResult applyUnary(UnaryOp op, const Literal &operand) {
+    Literal::Value value = operand.get();
+    switch (op) {
+    case UnaryOp::Negate:
+        if (const int *i = std::get_if<int>(&value)) {
+            if (*i == INT_MIN) {
+                return {std::nullopt, "Integer overflow"};
+            }
+            return {Literal(-*i)};
+        }
+        if (const double *d = std::get_if<double>(&value)) {
+            return {Literal(-*d)};
+        }
+        return {};
+    case UnaryOp::Not:
+        if (const bool *b = std::get_if<bool>(&value)) {
+            return {Literal(!*b)};
+        }
+        return {};
+    }
+    return {};
+}
+
+bool hasType(const Literal &literal, const Type &type) {
+    Literal::Value value = literal.get();
+    switch (type.kind) {
+    case PrimitiveType::I32:
+        return std::holds_alternative<int>(value);
+    case PrimitiveType::F64:
+        return std::holds_alternative<double>(value);
+    case PrimitiveType::Bool:
+        return std::holds_alternative<bool>(value);
+    default:
+        return false;
+    }
+}
@@ -1,3 +1,4 @@
+#include "daemon.hpp"
 #include "driver.hpp"
 
 #include <iostream>
@@ -8,7 +9,13 @@ int main(int argc, char **argv) {
         Driver driver;
         CompilerOptions opts = driver.parseArgs(argc, argv);
 
-        driver.compile(opts);
+        if (!opts.daemonSocket.empty()) {
+            Daemon daemon(opts.daemonSocket, opts.jobs);
+            daemon.serve();
+            return 0;
+        }
+
+        return driver.compile(opts, std::cout, std::cerr);
     } catch (const HelpException &) {
         return 0;
     } catch (const VersionException &) {
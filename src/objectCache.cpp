@@ -0,0 +1,27 @@
+#include "diskCache.hpp"
+#include "objectCache.hpp"
+
+#include <exception>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <memory>
+
+// both are called from inside LLVM, which no exception may cross
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module *module,
+                                           llvm::MemoryBufferRef object) {
+    try {
+        this->cache.store(module->getModuleIdentifier(), object.getBuffer());
+        this->cache.prune();
+    } catch (const std::exception &) {
+    }
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+DiskObjectCache::getObject(const llvm::Module *module) {
+    try {
+        return this->cache.load(module->getModuleIdentifier());
+    } catch (const std::exception &) {
+        return nullptr;
+    }
+}
@@ -0,0 +1,100 @@
+#include "ast.hpp"
+#include "codegen.hpp"
+#include "parallel.hpp"
+#include "parallelCodeGen.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <llvm/Support/raw_ostream.h>
+#include <string>
+#include <vector>
+
+std::vector<std::string> ParallelCodeGen::compile(NodeId program,
+                                                  llvm::raw_ostream &out,
+                                                  llvm::raw_ostream &err) {
+    std::vector<Part> parts = this->split(program);
+    LLVMCodeGen::FunctionIndex functions =
+        LLVMCodeGen::indexFunctions(this->ast, program);
+    std::vector<std::string> irs(parts.size());
+    std::vector<std::string> scopes(parts.size());
+    std::vector<std::exception_ptr> errors(parts.size());
+
+    parallelFor(parts.size(), this->opts.jobs, [&](std::size_t p) {
+        // threads must not share the streams
+        llvm::raw_string_ostream os(irs[p]);
+        llvm::raw_string_ostream scopeDump(scopes[p]);
+        try {
+            LLVMCodeGen codegen(this->interner, this->ast, this->opts);
+            codegen.setPartition(parts[p].first, parts[p].last,
+                                 /*defineGlobals=*/p == 0, functions);
+            codegen.redirectDumps(os, scopeDump);
+            codegen.generate(program);
+            codegen.optimize();
+            codegen.dumpIR(os);
+            codegen.emitObjectFile(this->objectFile(p, parts.size()));
+        } catch (...) {
+            errors[p] = std::current_exception();
+        }
+    });
+
+    // parts are runs of the program in order, so the first failing part
+    // holds the error a sequential compile would have stopped at
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+        if (errors[p]) {
+            out << irs[p];
+            err << scopes[p];
+            std::rethrow_exception(errors[p]);
+        }
+    }
+
+    std::vector<std::string> files;
+    for (std::size_t p = 0; p < parts.size(); ++p) {
+        out << irs[p];
+        files.push_back(this->objectFile(p, parts.size()));
+    }
+    return files;
+}
+
+std::vector<ParallelCodeGen::Part>
+ParallelCodeGen::split(NodeId program) const {
+    NodeList<NodeId> stmts = this->ast.stmts(program);
+
+    // A declaration's nodes are created right before it, in source order,
+    // so the gap between the ids of consecutive declarations is about the
+    // size of the later one.
+    std::vector<std::size_t> weights(stmts.size(), 0);
+    std::size_t total = 0;
+    std::size_t fnCount = 0;
+    for (std::size_t i = 0; i < stmts.size(); ++i) {
+        if (this->ast.kind(stmts[i]) != NodeKind::Fn) {
+            continue;
+        }
+        NodeId previous = i > 0 ? stmts[i - 1] : 0;
+        weights[i] = stmts[i] > previous ? stmts[i] - previous : 1;
+        total += weights[i];
+        ++fnCount;
+    }
+
+    std::size_t count = std::min<std::size_t>(this->opts.jobs, fnCount);
+    if (count <= 1) {
+        return {{0, stmts.size()}};
+    }
+
+    // cut wherever the running weight passes the next multiple of
+    // total / count; leaves no part without a function
+    std::vector<Part> parts;
+    std::size_t first = 0;
+    std::size_t weight = 0;
+    for (std::size_t i = 0; i < stmts.size() && parts.size() + 1 < count;
+         ++i) {
+        weight += weights[i];
+        if (weights[i] > 0 &&
+            weight * count >= total * (parts.size() + 1)) {
+            parts.push_back({first, i + 1});
+            first = i + 1;
+        }
+    }
+    parts.push_back({first, stmts.size()});
+    return parts;
+}
@@ -0,0 +1,156 @@
+#include "ast.hpp"
+#include "astContext.hpp"
+#include "parallel.hpp"
+#include "parallelParser.hpp"
+#include "parser.hpp"
+#include "token.hpp"
+#include "tokenStream.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+struct Batch {
+    ASTContext context;
+    std::vector<NodeId> decls;
+    bool ok = false;
+};
+
+} // namespace
+
+NodeId ParallelParser::parse() {
+    this->lexAll();
+
+    std::vector<std::size_t> starts;
+    if (this->lexError || !this->findDeclarations(starts) ||
+        starts.size() < 2) {
+        return this->parseSequential();
+    }
+
+    // the last start is the Eof token
+    std::size_t declCount = starts.size() - 1;
+    std::size_t batchCount =
+        std::min<std::size_t>(declCount, this->jobs * batchesPerJob);
+    std::vector<Batch> batches(batchCount);
+
+    parallelFor(batchCount, this->jobs, [&](std::size_t b) {
+        std::size_t first = declCount * b / batchCount;
+        std::size_t last = declCount * (b + 1) / batchCount;
+        Batch &batch = batches[b];
+
+        if (this->context.hashConsing()) {
+            batch.context.enableHashConsing();
+        }
+
+        try {
+            TokenStream stream(this->tokens, starts[first]);
+            Parser parser(stream, batch.context);
+            for (std::size_t d = first; d < last; ++d) {
+                batch.decls.push_back(parser.parseDeclaration());
+                if (stream.position() != starts[d + 1]) {
+                    return;
+                }
+            }
+            batch.ok = true;
+        } catch (...) {
+            // left for the sequential parse to report
+        }
+    });
+
+    for (const Batch &batch : batches) {
+        if (!batch.ok) {
+            return this->parseSequential();
+        }
+    }
+
+    std::vector<NodeId> decls;
+    decls.reserve(declCount);
+    for (const Batch &batch : batches) {
+        NodeId base = this->context.append(batch.context);
+        for (NodeId decl : batch.decls) {
+            decls.push_back(decl + base);
+        }
+    }
+
+    return this->context.addProgram(decls.data(), decls.size());
+}
+
+void ParallelParser::lexAll() {
+    try {
+        do {
+            this->lexer.next(this->tokens);
+        } while (this->tokens.type(this->tokens.end() - 1) != TokenType::Eof);
+    } catch (const std::runtime_error &) {
+        // reported once the parser reaches the token that failed
+        this->lexError = std::current_exception();
+    }
+}
+
+// Records the first token of every top-level declaration, followed by the
+// index of Eof. Returns false when the tokens do not split cleanly, in which
+// case the sequential parser reports what is wrong.
+bool ParallelParser::findDeclarations(std::vector<std::size_t> &starts) const {
+    std::size_t i = this->tokens.begin();
+
+    while (this->tokens.type(i) != TokenType::Eof) {
+        starts.push_back(i);
+
+        switch (this->tokens.type(i)) {
+        case TokenType::Fn: {
+            // the body is the first brace-delimited block
+            while (this->tokens.type(i) != TokenType::LeftBrace) {
+                if (this->tokens.type(i) == TokenType::Eof ||
+                    this->tokens.type(i) == TokenType::RightBrace) {
+                    return false;
+                }
+                ++i;
+            }
+
+            std::size_t depth = 0;
+            do {
+                switch (this->tokens.type(i)) {
+                case TokenType::LeftBrace:
+                    ++depth;
+                    break;
+                case TokenType::RightBrace:
+                    --depth;
+                    break;
+                case TokenType::Eof:
+                    return false;
+                default:
+                    break;
+                }
+                ++i;
+            } while (depth > 0);
+            break;
+        }
+        case TokenType::Let:
+        case TokenType::Return:
+            while (this->tokens.type(i) != TokenType::Semicolon) {
+                if (this->tokens.type(i) == TokenType::Eof ||
+                    this->tokens.type(i) == TokenType::LeftBrace ||
+                    this->tokens.type(i) == TokenType::RightBrace) {
+                    return false;
+                }
+                ++i;
+            }
+            ++i;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    starts.push_back(i);
+    return true;
+}
+
+NodeId ParallelParser::parseSequential() {
+    TokenStream stream(this->tokens, this->tokens.begin(), this->lexError);
+    Parser parser(stream, this->context);
+    return parser.parse();
+}
@@ -1,25 +1,40 @@
 #include "ast.hpp"
+#include "astContext.hpp"
+#include "operators.hpp"
 #include "parser.hpp"
 #include "token.hpp"
 #include "type.hpp"
 
-#include <memory>
+#include <cstddef>
+#include <cstdint>
 #include <stdexcept>
 #include <string>
-#include <utility>
+#include <string_view>
 #include <vector>
 
-std::unique_ptr<Program> Parser::parse() {
-    auto program = std::make_unique<Program>();
+NodeId Parser::parse() {
+    std::size_t mark = this->scratch.size();
 
     while (!this->isAtEnd()) {
-        program->stmts.push_back(this->declaration());
+        NodeId stmt = this->parseDeclaration();
+        this->scratch.push_back(stmt);
     }
 
+    NodeId program = this->context.addProgram(this->scratch.data() + mark,
+                                              this->scratch.size() - mark);
+    this->scratch.resize(mark);
     return program;
 }
 
-StmtPtr Parser::declaration() {
+NodeId Parser::parseDeclaration() {
+    NodeId decl = this->declaration();
+    // subexpressions are only shared within one top-level declaration, so
+    // parsing declarations separately builds the same tree
+    this->context.closeSharingScope();
+    return decl;
+}
+
+NodeId Parser::declaration() {
     if (this->peek().getType() == TokenType::Fn) {
         return this->fnDeclaration();
     } else if (this->peek().getType() == TokenType::Let) {
@@ -32,25 +47,27 @@ StmtPtr Parser::declaration() {
 }
 
 // fn [[identifier]]([[identifier]]: [[type]]): [[type]] [[block]]
-StmtPtr Parser::fnDeclaration() {
+NodeId Parser::fnDeclaration() {
     this->consume(TokenType::Fn, "Expected 'fn' keyword");
 
-    Token nameTok =
-        this->consume(TokenType::Identifier, "Expected function name");
+    Symbol name =
+        this->consume(TokenType::Identifier, "Expected function name")
+            .getSymbol();
 
     this->consume(TokenType::LeftParen, "Expected '(' after function name");
 
-    std::vector<FnParam> params;
+    std::size_t mark = this->paramScratch.size();
     while (!this->match(TokenType::RightParen)) {
         do {
-            Token paramNameTok =
-                this->consume(TokenType::Identifier, "Expected parameter name");
+            Symbol paramName =
+                this->consume(TokenType::Identifier, "Expected parameter name")
+                    .getSymbol();
             this->consume(TokenType::Colon,
                           "Expected ':' after parameter name");
             Token paramTypeTok =
                 this->consume(TokenType::Identifier, "Expected type after ':'");
             Type paramType = this->parseType(paramTypeTok.getLexeme());
-            params.emplace_back(paramNameTok.getLexeme(), paramType);
+            this->paramScratch.emplace_back(paramName, paramType);
         } while (this->match(TokenType::Comma));
     } // ')' consumed
 
@@ -60,14 +77,18 @@ StmtPtr Parser::fnDeclaration() {
         this->consume(TokenType::Identifier, "Expected type after ':'");
     Type retType = this->parseType(typeTok.getLexeme());
 
-    auto body = this->parseBlock();
+    NodeId body = this->parseBlock();
 
-    return std::make_unique<FnStmt>(nameTok.getLexeme(), params, retType,
-                                    std::move(body));
+    NodeId fn = this->context.addFn(name, this->paramScratch.data() + mark,
+                                    this->paramScratch.size() - mark, retType,
+                                    body);
+    this->paramScratch.erase(this->paramScratch.begin() + mark,
+                             this->paramScratch.end());
+    return fn;
 }
 
 // let (mut) [[identifier]]: [[type]] = [[expression]];
-StmtPtr Parser::letDeclaration() {
+NodeId Parser::letDeclaration() {
     this->consume(TokenType::Let, "Expected 'let' keyword");
 
     bool mut = false;
@@ -75,8 +96,9 @@ StmtPtr Parser::letDeclaration() {
         mut = true;
     }
 
-    Token nameTok =
-        this->consume(TokenType::Identifier, "Expected variable name");
+    Symbol name =
+        this->consume(TokenType::Identifier, "Expected variable name")
+            .getSymbol();
 
     this->consume(TokenType::Colon, "Expected ':' after variable name");
 
@@ -85,181 +107,175 @@ StmtPtr Parser::letDeclaration() {
 
     this->consume(TokenType::Equal, "Expected '=' after type");
 
-    auto initializer = this->expression();
+    NodeId initializer = this->expression();
 
     this->consume(TokenType::Semicolon, "Expected ';'");
 
-    return std::make_unique<LetStmt>(nameTok.getLexeme(), mut, type,
-                                     std::move(initializer));
+    return this->context.addLet(name, mut, type, initializer);
 }
 
 // return [[expression]];
-StmtPtr Parser::returnDeclaration() {
+NodeId Parser::returnDeclaration() {
     this->consume(TokenType::Return, "Expected 'return' keyword");
 
     if (this->peek().getType() == TokenType::Semicolon) {
         this->consume(TokenType::Semicolon, "Expected ';'");
-        return std::make_unique<ReturnStmt>();
+        return this->context.addReturn(noNode);
     }
 
-    auto value = this->expression();
+    NodeId value = this->expression();
 
     this->consume(TokenType::Semicolon, "Expected ';'");
 
-    return std::make_unique<ReturnStmt>(std::move(value));
+    return this->context.addReturn(value);
 }
 
-std::unique_ptr<BlockStmt> Parser::parseBlock() {
+NodeId Parser::parseBlock() {
     this->consume(TokenType::LeftBrace, "Expected '{'");
 
-    std::vector<StmtPtr> stmts;
+    std::size_t mark = this->scratch.size();
 
     while (!this->isAtEnd() &&
            this->peek().getType() != TokenType::RightBrace) {
-        stmts.push_back(this->declaration());
+        NodeId stmt = this->declaration();
+        this->scratch.push_back(stmt);
     }
 
     this->consume(TokenType::RightBrace, "Expected '}'");
 
-    return std::make_unique<BlockStmt>(std::move(stmts));
+    NodeId block = this->context.addBlock(this->scratch.data() + mark,
+                                          this->scratch.size() - mark);
+    this->scratch.resize(mark);
+    return block;
 }
 
-ExprPtr Parser::expression() {
-    auto lhs = this->unary();
-    if (!lhs) {
-        return nullptr;
-    }
-
-    return this->parseBinaryRhs(0, std::move(lhs));
-}
+// Operator-precedence parsing over explicit stacks, so that the nesting
+// depth of an expression is bounded by memory rather than by the native
+// stack. Finished operands wait on `operands`; operators, parentheses and
+// calls whose arguments are still being read wait on `operators`.
+NodeId Parser::expression() {
+    std::size_t base = this->operators.size();
 
-ExprPtr Parser::parseBinaryRhs(int minPrecedence, ExprPtr lhs) {
     while (true) {
-        const Token &tok = this->peek();
-        int tokPrec = this->getPrecedence(tok.getType());
-
-        // if the next token isn't a binary operator or it has lower precedence
-        // stop
-        if (tokPrec < minPrecedence) {
-            return lhs;
+        // an operand, after any number of prefix operators and '('
+        Token tok = this->peek();
+
+        if (this->match(TokenType::Minus) || this->match(TokenType::Bang)) {
+            UnaryOp op = tokenTypeToUnaryOp(this->previous().getType());
+            this->operators.push_back({PendingOp::Unary,
+                                       static_cast<std::uint8_t>(op),
+                                       prefixPrecedence, 0, 0});
+            continue;
         }
 
-        // consume operator
-        Token opToken = this->advance();
-
-        // handle rhs
-        auto rhs = this->unary();
-        if (!rhs) {
-            return nullptr;
+        if (this->match(TokenType::LeftParen)) {
+            this->operators.push_back({PendingOp::Paren, 0, 0, 0, 0});
+            continue;
         }
 
-        // if the next operator has higher precendence, connect it to the rhs
-        // recursively
-        int nextPrec = this->getPrecedence(this->peek().getType());
-        if (tokPrec < nextPrec) {
-            rhs = this->parseBinaryRhs(tokPrec + 1, std::move(rhs));
-            if (!rhs)
-                return nullptr;
+        if (this->match(TokenType::Number) || this->match(TokenType::True) ||
+            this->match(TokenType::False)) {
+            this->operands.push_back(
+                this->context.addLiteral(*this->previous().getLiteral()));
+        } else if (this->match(TokenType::Identifier)) {
+            Symbol name = this->previous().getSymbol();
+
+            if (this->match(TokenType::LeftParen)) {
+                // arguments are read as expressions of their own
+                if (this->peek().getType() != TokenType::RightParen) {
+                    this->operators.push_back(
+                        {PendingOp::Call, 0, 0, name,
+                         static_cast<std::uint32_t>(this->scratch.size())});
+                    continue;
+                }
+                this->consume(TokenType::RightParen,
+                              "Expected ')' after arguments.");
+                this->operands.push_back(
+                    this->context.addCall(name, nullptr, 0));
+            } else {
+                this->operands.push_back(this->context.addVariable(name));
+            }
+        } else {
+            throw std::runtime_error("Parser error at line " +
+                                     std::to_string(tok.getLine()) +
+                                     ": Expected expression, found '" +
+                                     std::string(tok.getLexeme()) + "'");
         }
 
-        lhs =
-            std::make_unique<BinaryExpr>(tokenTypeToBinaryOp(opToken.getType()),
-                                         std::move(lhs), std::move(rhs));
-    }
-}
-
-ExprPtr Parser::unary() {
-    if (this->match(TokenType::Minus) || this->match(TokenType::Bang)) {
-        Token opToken = this->previous();
-        auto operand = this->unary(); // recursion
-        return std::make_unique<UnaryExpr>(
-            tokenTypeToUnaryOp(opToken.getType()), std::move(operand));
-    }
-
-    return this->primary();
-}
-
-ExprPtr Parser::primary() {
-    const Token &tok = this->peek();
-
-    // literals
-    if (this->match(TokenType::Number) || this->match(TokenType::True) ||
-        this->match(TokenType::False)) {
-        return std::make_unique<LiteralExpr>(*this->previous().getLiteral());
-    }
-
-    // variable or function call
-    if (this->match(TokenType::Identifier)) {
-        std::string name = previous().getLexeme();
-
-        // if next token is ( it's a function call
-        if (match(TokenType::LeftParen)) {
-            return finishCall(name);
+        // after an operand: a binary operator, or the end of a bracket
+        while (true) {
+            const BinaryOperator &binary =
+                binaryOperator(this->peek().getType());
+            if (binary.precedence >= 0) {
+                this->reduce(base, binary.precedence, binary.rightAssoc);
+                this->advance();
+                this->operators.push_back(
+                    {PendingOp::Binary, static_cast<std::uint8_t>(binary.op),
+                     binary.precedence, 0, 0});
+                break;
+            }
+
+            // the innermost open expression is complete
+            this->reduce(base, -1, false);
+
+            if (this->operators.size() == base) {
+                NodeId result = this->operands.back();
+                this->operands.pop_back();
+                return result;
+            }
+
+            PendingOp open = this->operators.back();
+            if (open.kind == PendingOp::Paren) {
+                this->consume(TokenType::RightParen,
+                              "Expected ')' after expression");
+                this->operators.pop_back();
+                continue;
+            }
+
+            // an argument of the innermost call
+            this->scratch.push_back(this->operands.back());
+            this->operands.pop_back();
+            if (this->match(TokenType::Comma)) {
+                break;
+            }
+            this->consume(TokenType::RightParen,
+                          "Expected ')' after arguments.");
+            this->operators.pop_back();
+            this->operands.push_back(this->context.addCall(
+                open.callee, this->scratch.data() + open.argMark,
+                this->scratch.size() - open.argMark));
+            this->scratch.resize(open.argMark);
         }
-
-        // otherwise simple variable expression
-        return std::make_unique<VariableExpr>(name);
     }
-
-    // parentheses
-    if (this->match(TokenType::LeftParen)) {
-        auto expr = this->expression();
-        this->consume(TokenType::RightParen, "Expected ')' after expression");
-        return expr;
-    }
-
-    throw std::runtime_error(
-        "Parser error at line " + std::to_string(tok.getLine()) +
-        ": Expected expression, found '" + tok.getLexeme() + "'");
 }
 
-ExprPtr Parser::finishCall(const std::string &callee) {
-    std::vector<ExprPtr> args;
-
-    // if the next token is not ), parse args
-    if (peek().getType() != TokenType::RightParen) {
-        do {
-            // every arg is an expression
-            args.push_back(expression());
-        } while (match(TokenType::Comma)); // separated with commas
-    }
-
-    consume(TokenType::RightParen, "Expected ')' after arguments.");
-
-    return std::make_unique<CallExpr>(callee, std::move(args));
-}
+// Turns pending operators into nodes for as long as they bind at least as
+// tightly as an incoming operator of `precedence` (strictly tighter if that
+// one is right associative), stopping at the innermost open bracket.
+void Parser::reduce(std::size_t base, int precedence, bool rightAssoc) {
+    while (this->operators.size() > base) {
+        const PendingOp &top = this->operators.back();
+        if (top.kind == PendingOp::Paren || top.kind == PendingOp::Call ||
+            top.precedence < precedence ||
+            (top.precedence == precedence && rightAssoc)) {
+            return;
+        }
 
-int Parser::getPrecedence(TokenType type) const {
-    switch (type) {
-    case TokenType::Star:
-    case TokenType::Slash:
-    case TokenType::Percent:
-        return 6;
-    case TokenType::Plus:
-    case TokenType::Minus:
-        return 5;
-    case TokenType::Less:
-    case TokenType::LessEqual:
-    case TokenType::Greater:
-    case TokenType::GreaterEqual:
-        return 4;
-    case TokenType::EqualEqual:
-    case TokenType::BangEqual:
-        return 3;
-    // case TokenType::And:
-    //     return 2;
-    // case TokenType::Or:
-    //     return 1;
-    default:
-        return -1;
+        NodeId rhs = this->operands.back();
+        this->operands.pop_back();
+        if (top.kind == PendingOp::Unary) {
+            this->operands.push_back(
+                this->context.addUnary(static_cast<UnaryOp>(top.op), rhs));
+        } else {
+            BinaryOp op = static_cast<BinaryOp>(top.op);
+            NodeId lhs = this->operands.back();
+            this->operands.back() = this->context.addBinary(op, lhs, rhs);
+        }
+        this->operators.pop_back();
     }
 }
 
-bool Parser::isBinaryOp(TokenType type) const {
-    return this->getPrecedence(type) != -1;
-}
-
-Type Parser::parseType(const std::string &lexeme) {
+Type Parser::parseType(std::string_view lexeme) {
     if (lexeme == "void") {
         return Type(PrimitiveType::Void);
     } else if (lexeme == "i32") {
@@ -269,7 +285,7 @@ Type Parser::parseType(const std::string &lexeme) {
     } else if (lexeme == "bool") {
         return Type(PrimitiveType::Bool);
     } else {
-        throw std::runtime_error("Unknown type: " + lexeme);
+        throw std::runtime_error("Unknown type: " + std::string(lexeme));
     }
 }
 
@@ -277,40 +293,28 @@ bool Parser::match(TokenType type) {
     if (this->isAtEnd()) {
         return false;
     }
-    if (this->tokens[this->cur].getType() != type) {
+    if (this->tokens.peek().getType() != type) {
         return false;
     }
-    this->cur++;
+    this->tokens.advance();
     return true;
 }
 
-const Token &Parser::advance() {
-    if (!this->isAtEnd()) {
-        this->cur++;
-    }
-    return this->tokens[this->cur - 1];
-}
+Token Parser::advance() { return this->tokens.advance(); }
 
-const Token &Parser::consume(TokenType expected, const std::string &err) {
-    if (!this->isAtEnd() && this->tokens[this->cur].getType() == expected) {
-        return this->tokens[this->cur++];
+Token Parser::consume(TokenType expected, const char *err) {
+    if (!this->isAtEnd() && this->tokens.peek().getType() == expected) {
+        return this->tokens.advance();
     }
     throw std::runtime_error("Parser error at line " +
                              std::to_string(this->peek().getLine()) + ": " +
                              err);
 }
 
-const Token &Parser::peek() const {
-    if (this->isAtEnd()) {
-        static Token eofToken(TokenType::Eof, "", std::nullopt, 0);
-        return eofToken;
-    }
-    return this->tokens[this->cur];
-}
+Token Parser::peek() { return this->tokens.peek(); }
 
-const Token &Parser::previous() const { return this->tokens[this->cur - 1]; }
+Token Parser::previous() const { return this->tokens.previous(); }
 
-bool Parser::isAtEnd() const {
-    return this->cur >= (int)this->tokens.size() ||
-           this->tokens[this->cur].getType() == TokenType::Eof;
+bool Parser::isAtEnd() {
+    return this->tokens.peek().getType() == TokenType::Eof;
 }
@@ -0,0 +1,70 @@
+#include "sourceFile.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+SourceFile::SourceFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("File `" + path + "` not found");
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            // the lexer walks the file front to back exactly once
+            ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            this->data = static_cast<const char *>(addr);
+            this->size = st.st_size;
+            this->mapped = true;
+        }
+    }
+
+    if (this->mapped) {
+        ::close(fd);
+        return;
+    }
+
+    // read from the fd already open: reopening a pipe would drop its writer
+    char chunk[64 * 1024];
+    for (;;) {
+        ssize_t got = ::read(fd, chunk, sizeof chunk);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            int error = errno;
+            ::close(fd);
+            throw std::runtime_error("Cannot read `" + path +
+                                     "`: " + std::strerror(error));
+        }
+        if (got == 0) {
+            break;
+        }
+        this->fallback.append(chunk, static_cast<std::size_t>(got));
+    }
+    ::close(fd);
+
+    this->data = this->fallback.data();
+    this->size = this->fallback.size();
+}
+
+SourceFile::~SourceFile() {
+    if (this->mapped) {
+        ::munmap(const_cast<char *>(this->data), this->size);
+    }
+}
+
+bool SourceFile::isRegularFile(const std::string &path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+}
@@ -0,0 +1,172 @@
+#include "compilerOptions.hpp"
+#include "target.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/MC/MCSubtargetInfo.h>
+#include <llvm/MC/TargetRegistry.h>
+#include <llvm/Support/CodeGen.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Target/TargetMachine.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/TargetParser/Host.h>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// idle machines by what they generate code for
+struct TargetMachinePool {
+    std::mutex mutex;
+    std::unordered_map<std::string,
+                       std::vector<std::unique_ptr<llvm::TargetMachine>>>
+        idle;
+};
+
+TargetMachinePool &pool() {
+    static TargetMachinePool pool;
+    return pool;
+}
+
+// per target, as many as -j runs compiles in parallel by default
+std::size_t maxIdleMachines() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::string poolKey(const std::string &triple, const std::string &cpu,
+                    const std::string &features, llvm::CodeGenOptLevel level) {
+    return triple + "\n" + cpu + "\n" + features + "\n" +
+           std::to_string(static_cast<int>(level));
+}
+
+std::unique_ptr<llvm::TargetMachine>
+createTargetMachine(const std::string &targetTriple,
+                    const TargetSelection &selection,
+                    llvm::CodeGenOptLevel level) {
+    // initialize all targets for the host machine, once: code generators of
+    // the parts of a program can get here from several threads
+    static std::once_flag initialized;
+    std::call_once(initialized, [] {
+        llvm::InitializeAllTargetInfos();
+        llvm::InitializeAllTargets();
+        llvm::InitializeAllTargetMCs();
+        llvm::InitializeAllAsmParsers();
+        llvm::InitializeAllAsmPrinters();
+    });
+
+    // look up the target
+    std::string error;
+    auto target = llvm::TargetRegistry::lookupTarget(targetTriple, error);
+    if (!target) {
+        throw std::runtime_error(error);
+    }
+
+    // LLVM only warns about an unknown CPU and then fails much later
+    std::unique_ptr<llvm::MCSubtargetInfo> subtarget(
+        target->createMCSubtargetInfo(targetTriple, "", ""));
+    if (!subtarget->isCPUStringValid(selection.cpu)) {
+        throw std::runtime_error("Unknown CPU `" + selection.cpu + "` for " +
+                                 targetTriple);
+    }
+
+    // configure the target machine, optimizing like clang does at the same
+    // -O level
+    llvm::TargetOptions opt;
+    std::optional<llvm::Reloc::Model> RM = llvm::Reloc::PIC_;
+    return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+        targetTriple, selection.cpu, selection.features, opt, RM,
+        std::nullopt, level));
+}
+
+} // namespace
+
+TargetSelection selectTarget(const CompilerOptions &opts) {
+    TargetSelection target{opts.cpu, ""};
+
+    if (target.cpu == "native") {
+        target.cpu = llvm::sys::getHostCPUName().str();
+
+        // sorted so the same host always produces the same IR
+        llvm::StringMap<bool> hostFeatures;
+        std::vector<std::string> enabled;
+        if (llvm::sys::getHostCPUFeatures(hostFeatures)) {
+            for (const auto &feature : hostFeatures) {
+                enabled.push_back((feature.getValue() ? "+" : "-") +
+                                  feature.getKey().str());
+            }
+        }
+        std::sort(enabled.begin(), enabled.end());
+        for (const std::string &feature : enabled) {
+            if (!target.features.empty()) {
+                target.features += ',';
+            }
+            target.features += feature;
+        }
+    }
+
+    if (!opts.features.empty()) {
+        if (!target.features.empty()) {
+            target.features += ',';
+        }
+        target.features += opts.features;
+    }
+
+    return target;
+}
+
+llvm::CodeGenOptLevel codeGenOptLevel(OptLevel level) {
+    switch (level) {
+    case OptLevel::O0:
+        return llvm::CodeGenOptLevel::None;
+    case OptLevel::O1:
+        return llvm::CodeGenOptLevel::Less;
+    case OptLevel::O2:
+    case OptLevel::Os:
+    case OptLevel::Oz:
+        return llvm::CodeGenOptLevel::Default;
+    case OptLevel::O3:
+        return llvm::CodeGenOptLevel::Aggressive;
+    }
+    return llvm::CodeGenOptLevel::Default;
+}
+
+std::unique_ptr<llvm::TargetMachine>
+acquireTargetMachine(const TargetSelection &target, OptLevel level) {
+    // define the target triple (the host machine's)
+    std::string triple = llvm::sys::getDefaultTargetTriple();
+    llvm::CodeGenOptLevel codeGenLevel = codeGenOptLevel(level);
+    {
+        std::lock_guard<std::mutex> lock(pool().mutex);
+        auto idle = pool().idle.find(
+            poolKey(triple, target.cpu, target.features, codeGenLevel));
+        if (idle != pool().idle.end() && !idle->second.empty()) {
+            std::unique_ptr<llvm::TargetMachine> machine =
+                std::move(idle->second.back());
+            idle->second.pop_back();
+            return machine;
+        }
+    }
+    return createTargetMachine(triple, target, codeGenLevel);
+}
+
+void releaseTargetMachine(std::unique_ptr<llvm::TargetMachine> machine) {
+    std::string key = poolKey(machine->getTargetTriple().str(),
+                              machine->getTargetCPU().str(),
+                              machine->getTargetFeatureString().str(),
+                              machine->getOptLevel());
+    std::lock_guard<std::mutex> lock(pool().mutex);
+    std::vector<std::unique_ptr<llvm::TargetMachine>> &idle = pool().idle[key];
+    // a long-lived process like the daemon would otherwise keep as many as
+    // it ever used at once; the extras go once the lock is released
+    if (idle.size() < maxIdleMachines()) {
+        idle.push_back(std::move(machine));
+    }
+}
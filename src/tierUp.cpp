@@ -0,0 +1,122 @@
+#include "codegen.hpp"
+#include "compilerOptions.hpp"
+#include "jit.hpp"
+#include "tierUp.hpp"
+#include "vm.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace {
+
+double millis(std::chrono::steady_clock::time_point from,
+              std::chrono::steady_clock::time_point to) {
+    return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+} // namespace
+
+TierUp::TierUp(const Interner &interner, const ASTContext &ast,
+               NodeId program, const BytecodeModule &module, VM &vm,
+               const CompilerOptions &opts)
+    : interner(interner), ast(ast), program(program), module(module), vm(vm),
+      opts(opts) {
+    this->opts.optLevel = OptLevel::O2;
+    this->worker = std::thread([this] { this->work(); });
+}
+
+void TierUp::request(std::uint32_t fn) {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->queue.push_back({fn, Clock::now()});
+    }
+    this->wake.notify_one();
+}
+
+void TierUp::finish() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_one();
+    if (this->worker.joinable()) {
+        this->worker.join();
+    }
+}
+
+void TierUp::work() {
+    std::unique_lock<std::mutex> lock(this->mutex);
+    for (;;) {
+        this->wake.wait(lock, [this] {
+            return this->stopping || !this->queue.empty();
+        });
+        if (this->stopping) {
+            return;
+        }
+        Request request = this->queue.front();
+        this->queue.pop_front();
+        lock.unlock();
+
+        // a function that fails to compile just stays interpreted
+        Event event{request.fn, millis(this->start, request.at), -1, 0, ""};
+        Clock::time_point begin = Clock::now();
+        try {
+            this->vm.install(request.fn, this->compile(request.fn));
+            Clock::time_point installed = Clock::now();
+            event.installedMs = millis(this->start, installed);
+            event.compileMs = millis(begin, installed);
+        } catch (const std::exception &e) {
+            event.error = e.what();
+        }
+
+        lock.lock();
+        this->events.push_back(event);
+    }
+}
+
+VM::NativeFn TierUp::compile(std::uint32_t fn) {
+    if (!this->jit) {
+        LLVMCodeGen codegen(this->interner, this->ast, this->opts);
+        codegen.generate(this->program);
+        codegen.generateSlotEntries();
+        codegen.optimize();
+
+        this->jit = std::make_unique<JIT>(this->opts, /*lazy=*/true);
+        this->jit->addModule(codegen.takeModule());
+    }
+    return this->jit->lookupSlotEntry(this->module.functions[fn].name);
+}
+
+void TierUp::dumpStats(std::ostream &os) const {
+    std::lock_guard<std::mutex> lock(this->mutex);
+
+    os << "=== TIER STATS ===\n" << std::fixed << std::setprecision(3);
+    for (const Event &event : this->events) {
+        const std::string &name = this->module.functions[event.fn].name;
+        if (!event.error.empty()) {
+            os << "tier-up of '" << name << "' failed: " << event.error
+               << "\n";
+            continue;
+        }
+        os << "tier-up of '" << name << "': requested at "
+           << event.requestedMs << " ms, compiled in " << event.compileMs
+           << " ms, native from " << event.installedMs << " ms\n";
+    }
+    for (std::uint32_t fn = 0; fn < this->module.functions.size(); ++fn) {
+        std::uint64_t interpreted = this->vm.interpretedCalls(fn);
+        std::uint64_t native = this->vm.nativeCalls(fn);
+        if (interpreted + native > 0) {
+            os << "'" << this->module.functions[fn].name
+               << "': " << interpreted << " interpreted, " << native
+               << " native calls\n";
+        }
+    }
+    os << "==================" << std::endl;
+}
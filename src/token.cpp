@@ -1,5 +1,12 @@
 #include "token.hpp"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+
 std::ostream &operator<<(std::ostream &os, TokenType t) {
     switch (t) {
     case TokenType::LeftParen:
@@ -80,3 +87,99 @@ std::ostream &operator<<(std::ostream &os, TokenType t) {
     }
     return os;
 }
+
+void TokenStore::push(TokenType type, std::uint32_t offset,
+                      std::uint16_t length, int line,
+                      std::optional<Literal> literal) {
+    std::size_t index = this->end();
+
+    this->types.push_back(type);
+    this->offsets.push_back(offset);
+    this->lengths.push_back(length);
+
+    std::uint32_t payload = noNumber;
+    if (type == TokenType::Number && literal) {
+        payload = this->firstNumber +
+                  static_cast<std::uint32_t>(this->numbers.size());
+        this->numbers.push_back(*literal);
+    }
+    this->payloads.push_back(payload);
+
+    if (this->lines.empty() || this->lines.back().line != line) {
+        this->lines.push_back({(std::uint32_t)index, line});
+    }
+}
+
+void TokenStore::pushIdentifier(std::uint32_t offset, std::uint16_t length,
+                                int line, Symbol name) {
+    this->push(TokenType::Identifier, offset, length, line, std::nullopt);
+    this->payloads.back() = name;
+}
+
+void TokenStore::dropFront(std::size_t count) {
+    count = std::min(count, this->types.size());
+    std::size_t newFirst = this->first + count;
+
+    // the numbers among the dropped tokens are the oldest ones
+    std::uint32_t numberEnd = this->firstNumber;
+    for (std::size_t i = 0; i < count; ++i) {
+        if (this->types[i] == TokenType::Number &&
+            this->payloads[i] != noNumber) {
+            numberEnd = this->payloads[i] + 1;
+        }
+    }
+    this->numbers.erase(this->numbers.begin(),
+                        this->numbers.begin() +
+                            (numberEnd - this->firstNumber));
+    this->firstNumber = numberEnd;
+
+    this->types.erase(this->types.begin(), this->types.begin() + count);
+    this->offsets.erase(this->offsets.begin(), this->offsets.begin() + count);
+    this->lengths.erase(this->lengths.begin(), this->lengths.begin() + count);
+    this->payloads.erase(this->payloads.begin(),
+                         this->payloads.begin() + count);
+
+    // keep the run that covers the new first token
+    auto run = std::upper_bound(
+        this->lines.begin(), this->lines.end(), newFirst,
+        [](std::size_t i, const LineRun &r) { return i < r.index; });
+    if (run != this->lines.begin()) {
+        this->lines.erase(this->lines.begin(), run - 1);
+    }
+
+    this->first = newFirst;
+}
+
+std::optional<Literal> TokenStore::literal(std::size_t index) const {
+    switch (this->type(index)) {
+    case TokenType::True:
+        return Literal(true);
+    case TokenType::False:
+        return Literal(false);
+    case TokenType::Number: {
+        std::uint32_t payload = this->payloads[index - this->first];
+        if (payload == noNumber) {
+            return std::nullopt;
+        }
+        return this->numbers[payload - this->firstNumber];
+    }
+    default:
+        return std::nullopt;
+    }
+}
+
+Symbol TokenStore::symbol(std::size_t index) const {
+    if (index < this->begin() || index >= this->end() ||
+        this->type(index) != TokenType::Identifier) {
+        throw std::runtime_error("Token " + std::to_string(index) +
+                                 " is not an identifier");
+    }
+    return this->payloads[index - this->first];
+}
+
+int TokenStore::line(std::size_t index) const {
+    auto run = std::upper_bound(
+        this->lines.begin(), this->lines.end(), index,
+        [](std::size_t i, const LineRun &r) { return i < r.index; });
+    return run == this->lines.begin() ? 0 : (run - 1)->line;
+}
@@ -0,0 +1,19 @@
+#include "lexer.hpp"
+#include "token.hpp"
+#include "tokenStream.hpp"
+
+#include <exception>
+
+void TokenStream::pull() {
+    if (!this->lexer) {
+        std::rethrow_exception(this->pending);
+    }
+
+    std::size_t held = this->store.end() - this->store.begin();
+    if (held >= 2 * window) {
+        this->store.dropFront(held - window);
+        this->lexer->release(this->store.offset(this->store.begin()));
+    }
+
+    this->lexer->next(this->store);
+}
@@ -0,0 +1,261 @@
+#include "bytecode.hpp"
+#include "vm.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+namespace {
+
+// i32 arithmetic wraps, like the add/sub/mul codegen emits
+std::int32_t wrapAdd(std::int32_t lhs, std::int32_t rhs) {
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(lhs) +
+                                     static_cast<std::uint32_t>(rhs));
+}
+
+std::int32_t wrapSub(std::int32_t lhs, std::int32_t rhs) {
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(lhs) -
+                                     static_cast<std::uint32_t>(rhs));
+}
+
+std::int32_t wrapMul(std::int32_t lhs, std::int32_t rhs) {
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(lhs) *
+                                     static_cast<std::uint32_t>(rhs));
+}
+
+} // namespace
+
+VM::VM(const BytecodeModule &module)
+    : module(module), globals(module.globals),
+      registers(new Slot[maxRegisters]), frames(new Frame[maxFrames]),
+      native(new std::atomic<NativeFn>[module.functions.size()]),
+      interpreted(module.functions.size()),
+      compiled(module.functions.size()) {
+    for (std::size_t i = 0; i < module.functions.size(); ++i) {
+        this->native[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void VM::setTierUp(std::uint64_t threshold,
+                   std::function<void(std::uint32_t)> onHot) {
+    this->threshold = threshold;
+    this->onHot = std::move(onHot);
+}
+
+// Threaded dispatch where the compiler has labels as values (GCC, Clang):
+// every handler ends in its own indirect jump to the next one, which the
+// branch predictor learns far better than the single jump of a switch.
+// Anywhere else the same handlers are the cases of a switch.
+#if defined(__GNUC__)
+#define SLUG_THREADED_DISPATCH
+#endif
+
+#ifdef SLUG_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#ifdef __clang__
+#pragma clang diagnostic ignored "-Wgnu-label-as-value"
+#endif
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto *dispatch[static_cast<std::size_t>(pc->op)]
+#else
+#define VM_CASE(name) case Op::name:
+#define VM_NEXT() goto next
+#endif
+
+// a = b op c
+#define VM_BINARY(name, member, result, expr)                                  \
+    VM_CASE(name) {                                                            \
+        auto lhs = r[pc->b].member;                                            \
+        auto rhs = r[pc->c].member;                                            \
+        r[pc->a].result = (expr);                                              \
+        ++pc;                                                                  \
+        VM_NEXT();                                                             \
+    }
+
+int VM::run() {
+#ifdef SLUG_THREADED_DISPATCH
+#define SLUG_OPCODE_LABEL(name) &&op_##name,
+    static void *const dispatch[] = {SLUG_OPCODES(SLUG_OPCODE_LABEL)};
+#undef SLUG_OPCODE_LABEL
+#endif
+
+    // the interpreter state lives in locals so it can stay in registers
+    const BytecodeFunction *functions = this->module.functions.data();
+    Slot *globals = this->globals.data();
+    Slot *end = this->registers.get() + maxRegisters;
+    Frame *frames = this->frames.get();
+    std::size_t depth = 0;
+    std::atomic<NativeFn> *native = this->native.get();
+    std::uint64_t *interpreted = this->interpreted.data();
+
+    const BytecodeFunction *fn = &functions[this->module.mainIndex];
+    ++interpreted[this->module.mainIndex];
+    Slot *r = this->registers.get();
+    const Slot *k = fn->constants.data();
+    const Instr *pc = fn->code.data();
+    if (fn->registerCount > maxRegisters) {
+        fail("Stack overflow", *fn);
+    }
+
+#ifdef SLUG_THREADED_DISPATCH
+    VM_NEXT();
+#else
+next:
+    switch (pc->op) {
+#endif
+
+    VM_CASE(LoadConst) {
+        r[pc->a] = k[pc->index()];
+        ++pc;
+        VM_NEXT();
+    }
+    VM_CASE(LoadGlobal) {
+        r[pc->a] = globals[pc->index()];
+        ++pc;
+        VM_NEXT();
+    }
+    VM_CASE(Move) {
+        r[pc->a] = r[pc->b];
+        ++pc;
+        VM_NEXT();
+    }
+
+    VM_BINARY(AddI, i, i, wrapAdd(lhs, rhs))
+    VM_BINARY(SubI, i, i, wrapSub(lhs, rhs))
+    VM_BINARY(MulI, i, i, wrapMul(lhs, rhs))
+    VM_CASE(DivI) {
+        std::int32_t lhs = r[pc->b].i;
+        std::int32_t rhs = r[pc->c].i;
+        if (rhs == 0) {
+            fail("Division by zero", *fn);
+        }
+        if (lhs == INT32_MIN && rhs == -1) {
+            fail("Integer overflow", *fn);
+        }
+        r[pc->a].i = lhs / rhs;
+        ++pc;
+        VM_NEXT();
+    }
+    VM_CASE(ModI) {
+        std::int32_t lhs = r[pc->b].i;
+        std::int32_t rhs = r[pc->c].i;
+        if (rhs == 0) {
+            fail("Division by zero", *fn);
+        }
+        if (lhs == INT32_MIN && rhs == -1) {
+            fail("Integer overflow", *fn);
+        }
+        r[pc->a].i = lhs % rhs;
+        ++pc;
+        VM_NEXT();
+    }
+
+    VM_BINARY(AddF, f, f, lhs + rhs)
+    VM_BINARY(SubF, f, f, lhs - rhs)
+    VM_BINARY(MulF, f, f, lhs * rhs)
+    VM_BINARY(DivF, f, f, lhs / rhs)
+    VM_BINARY(ModF, f, f, std::fmod(lhs, rhs))
+
+    VM_BINARY(EqI, i, i, lhs == rhs)
+    VM_BINARY(NeI, i, i, lhs != rhs)
+    VM_BINARY(LtI, i, i, lhs < rhs)
+    VM_BINARY(LeI, i, i, lhs <= rhs)
+    VM_BINARY(GtI, i, i, lhs > rhs)
+    VM_BINARY(GeI, i, i, lhs >= rhs)
+
+    // ordered comparisons, as codegen emits them
+    VM_BINARY(EqF, f, i, lhs == rhs)
+    VM_BINARY(NeF, f, i, lhs < rhs || lhs > rhs)
+    VM_BINARY(LtF, f, i, lhs < rhs)
+    VM_BINARY(LeF, f, i, lhs <= rhs)
+    VM_BINARY(GtF, f, i, lhs > rhs)
+    VM_BINARY(GeF, f, i, lhs >= rhs)
+
+    VM_CASE(NegI) {
+        r[pc->a].i = wrapSub(0, r[pc->b].i);
+        ++pc;
+        VM_NEXT();
+    }
+    VM_CASE(NegF) {
+        r[pc->a].f = -r[pc->b].f;
+        ++pc;
+        VM_NEXT();
+    }
+    VM_CASE(Not) {
+        r[pc->a].i = r[pc->b].i ^ 1;
+        ++pc;
+        VM_NEXT();
+    }
+
+    VM_CASE(Call) {
+        std::uint32_t index = pc->index();
+        Slot *base = r + pc->a;
+        if (NativeFn code = native[index].load(std::memory_order_acquire)) {
+            ++this->compiled[index];
+            code(base);
+            ++pc;
+            VM_NEXT();
+        }
+        if (++interpreted[index] == this->threshold) {
+            this->onHot(index);
+        }
+
+        const BytecodeFunction *callee = &functions[index];
+        if (depth == maxFrames ||
+            callee->registerCount > static_cast<std::size_t>(end - base)) {
+            fail("Stack overflow", *callee);
+        }
+        frames[depth++] = {pc + 1, r, fn};
+        fn = callee;
+        r = base;
+        k = fn->constants.data();
+        pc = fn->code.data();
+        VM_NEXT();
+    }
+    VM_CASE(Ret) {
+        Slot result = r[pc->a];
+        if (depth == 0) {
+            return result.i;
+        }
+        r[0] = result;
+        const Frame &frame = frames[--depth];
+        pc = frame.pc;
+        r = frame.base;
+        fn = frame.fn;
+        k = fn->constants.data();
+        VM_NEXT();
+    }
+    VM_CASE(RetVoid) {
+        if (depth == 0) {
+            return 0;
+        }
+        const Frame &frame = frames[--depth];
+        pc = frame.pc;
+        r = frame.base;
+        fn = frame.fn;
+        k = fn->constants.data();
+        VM_NEXT();
+    }
+
+#ifndef SLUG_THREADED_DISPATCH
+    }
+    return 0; // every handler jumps or returns
+#endif
+}
+
+#undef VM_BINARY
+#undef VM_NEXT
+#undef VM_CASE
+#ifdef SLUG_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
+
+void VM::fail(const std::string &what, const BytecodeFunction &fn) {
+    throw std::runtime_error(what + " in function '" + fn.name + "'");
+}